@@ -0,0 +1,101 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   hex_bench.cpp
+ * Author: alex
+ *
+ * Created on November 23, 2020, 5:08 PM
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "staticlib/io.hpp"
+
+#include "hex_decoder.hpp"
+
+namespace { // anonymous
+
+std::string random_hex(size_t bytes_count) {
+    static const char* digits = "0123456789abcdef";
+    auto rng = std::mt19937(42);
+    auto res = std::string();
+    res.reserve(bytes_count * 2);
+    for (size_t i = 0; i < bytes_count; i++) {
+        auto byte = static_cast<unsigned char>(rng());
+        res.push_back(digits[byte >> 4]);
+        res.push_back(digits[byte & 0x0f]);
+    }
+    return res;
+}
+
+// the way hex input was decoded before
+std::vector<char> decode_source_chain(const std::string& hex) {
+    auto src_hex = sl::io::array_source(hex.data(), hex.length());
+    auto sink_bin = sl::io::make_array_sink();
+    auto src = sl::io::make_hex_source(src_hex);
+    sl::io::copy_all(src, sink_bin);
+    return std::vector<char>(sink_bin.data(), sink_bin.data() + sink_bin.size());
+}
+
+template<typename Fun>
+double millis_per_decode(size_t iterations, Fun fun) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        fun();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return static_cast<double>(micros) / 1000 / static_cast<double>(iterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t bytes_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5 * 1024 * 1024;
+    size_t iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20;
+    auto hex = random_hex(bytes_count);
+    auto expected = decode_source_chain(hex);
+    auto actual = wilton::pdf::decode_hex({hex.data(), hex.length()});
+    if (expected != actual) {
+        std::cerr << "ERROR: decoded data mismatch" << std::endl;
+        return 1;
+    }
+    double chain = millis_per_decode(iterations, [&hex] {
+        decode_source_chain(hex);
+    });
+    double direct = millis_per_decode(iterations, [&hex] {
+        wilton::pdf::decode_hex({hex.data(), hex.length()});
+    });
+    std::cout << "{" << std::endl;
+    std::cout << "    \"bytes\": " << bytes_count << "," << std::endl;
+    std::cout << "    \"iterations\": " << iterations << "," << std::endl;
+#ifdef WILTON_PDF_HEX_SSE2
+    std::cout << "    \"sse2\": true," << std::endl;
+#else
+    std::cout << "    \"sse2\": false," << std::endl;
+#endif
+    std::cout << "    \"sourceChainMillis\": " << chain << "," << std::endl;
+    std::cout << "    \"decoderMillis\": " << direct << std::endl;
+    std::cout << "}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,642 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   pdf_bench.cpp
+ * Author: alex
+ *
+ * Created on November 13, 2020, 3:44 PM
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "jpeglib.h"
+
+#include "wiltoncall_client.hpp"
+
+// font shipped with the benchmark, is set from CMake
+#ifndef WILTON_PDF_BENCH_FONT
+#define WILTON_PDF_BENCH_FONT "bench/fonts/SourceCodePro-Regular.ttf"
+#endif // WILTON_PDF_BENCH_FONT
+
+namespace { // anonymous
+
+// allocations made by the current thread, both in module and in client code
+thread_local uint64_t thread_allocations = 0;
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    thread_allocations += 1;
+    void* ptr = std::malloc(size > 0 ? size : 1);
+    if (nullptr == ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+namespace { // anonymous
+
+struct bench_options {
+    size_t threads = 4;
+    size_t iterations = 1000;
+    // documents are recreated after this number of calls
+    // to keep their size bounded, recreation is not measured
+    size_t calls_per_document = 200;
+    std::string font_path = WILTON_PDF_BENCH_FONT;
+    // generated when not specified
+    std::string jpeg_path;
+    std::string out_dir = ".";
+    std::string config = wiltoncall_default_config;
+};
+
+// output fields are flat and well-formed, no JSON parser is needed
+std::string json_field(const std::string& json, const std::string& name) {
+    auto key = "\"" + name + "\"";
+    auto pos = json.find(key);
+    if (std::string::npos == pos) throw std::runtime_error(
+            "Field not found, name: [" + name + "], json: [" + json + "]");
+    pos = json.find(':', pos + key.length()) + 1;
+    while (' ' == json[pos]) pos++;
+    if ('"' == json[pos]) {
+        auto end = json.find('"', pos + 1);
+        return json.substr(pos + 1, end - pos - 1);
+    }
+    auto end = json.find_first_of(",} \n", pos);
+    return json.substr(pos, end - pos);
+}
+
+std::string escape_path(const std::string& path) {
+    auto res = std::string();
+    for (char ch : path) {
+        if ('\\' == ch || '"' == ch) res.push_back('\\');
+        res.push_back(ch);
+    }
+    return res;
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open()) throw std::runtime_error("Error opening file, path: [" + path + "]");
+    return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string& path, const std::string& data) {
+    std::ofstream stream(path, std::ios::binary);
+    stream.write(data.data(), static_cast<std::streamsize>(data.length()));
+    if (!stream.good()) throw std::runtime_error("Error writing file, path: [" + path + "]");
+}
+
+std::string to_hex(const std::string& data) {
+    static const char* symbols = "0123456789abcdef";
+    auto res = std::string();
+    res.reserve(data.length() * 2);
+    for (char ch : data) {
+        auto byte = static_cast<unsigned char>(ch);
+        res.push_back(symbols[byte >> 4]);
+        res.push_back(symbols[byte & 0xf]);
+    }
+    return res;
+}
+
+std::string to_base64(const std::string& data) {
+    static const char* symbols = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    auto res = std::string();
+    res.reserve((data.length() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.length(); i += 3) {
+        size_t left = data.length() - i;
+        uint32_t triple = static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << 16;
+        if (left > 1) triple |= static_cast<uint32_t>(static_cast<unsigned char>(data[i + 1])) << 8;
+        if (left > 2) triple |= static_cast<uint32_t>(static_cast<unsigned char>(data[i + 2]));
+        res.push_back(symbols[(triple >> 18) & 0x3f]);
+        res.push_back(symbols[(triple >> 12) & 0x3f]);
+        res.push_back(left > 1 ? symbols[(triple >> 6) & 0x3f] : '=');
+        res.push_back(left > 2 ? symbols[triple & 0x3f] : '=');
+    }
+    return res;
+}
+
+uint32_t crc32(const std::string& data, size_t from) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = from; i < data.length(); i++) {
+        crc ^= static_cast<unsigned char>(data[i]);
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+void append_be32(std::string& out, uint32_t val) {
+    out.push_back(static_cast<char>((val >> 24) & 0xff));
+    out.push_back(static_cast<char>((val >> 16) & 0xff));
+    out.push_back(static_cast<char>((val >> 8) & 0xff));
+    out.push_back(static_cast<char>(val & 0xff));
+}
+
+void append_png_chunk(std::string& out, const std::string& type, const std::string& data) {
+    append_be32(out, static_cast<uint32_t>(data.length()));
+    auto body = type + data;
+    out.append(body);
+    append_be32(out, crc32(body, 0));
+}
+
+// RGB gradient, zlib stream with stored (uncompressed) deflate blocks
+std::string synthetic_png(uint32_t width, uint32_t height) {
+    auto raw = std::string();
+    for (uint32_t y = 0; y < height; y++) {
+        raw.push_back('\0');
+        for (uint32_t x = 0; x < width; x++) {
+            raw.push_back(static_cast<char>(x * 255 / width));
+            raw.push_back(static_cast<char>(y * 255 / height));
+            raw.push_back(static_cast<char>(128));
+        }
+    }
+    auto zlib = std::string("\x78\x01", 2);
+    size_t pos = 0;
+    do {
+        size_t len = std::min(raw.length() - pos, static_cast<size_t>(65535));
+        zlib.push_back(pos + len == raw.length() ? '\x01' : '\x00');
+        zlib.push_back(static_cast<char>(len & 0xff));
+        zlib.push_back(static_cast<char>((len >> 8) & 0xff));
+        zlib.push_back(static_cast<char>(~len & 0xff));
+        zlib.push_back(static_cast<char>((~len >> 8) & 0xff));
+        zlib.append(raw, pos, len);
+        pos += len;
+    } while (pos < raw.length());
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (char ch : raw) {
+        a = (a + static_cast<unsigned char>(ch)) % 65521;
+        b = (b + a) % 65521;
+    }
+    append_be32(zlib, (b << 16) | a);
+
+    auto ihdr = std::string();
+    append_be32(ihdr, width);
+    append_be32(ihdr, height);
+    ihdr.append("\x08\x02\x00\x00\x00", 5);
+    auto png = std::string("\x89PNG\r\n\x1a\n", 8);
+    append_png_chunk(png, "IHDR", ihdr);
+    append_png_chunk(png, "IDAT", zlib);
+    append_png_chunk(png, "IEND", "");
+    return png;
+}
+
+// same gradient as PNG, encoded with libjpeg
+std::string synthetic_jpeg(uint32_t width, uint32_t height) {
+    auto raw = std::string();
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            raw.push_back(static_cast<char>(x * 255 / width));
+            raw.push_back(static_cast<char>(y * 255 / height));
+            raw.push_back(static_cast<char>(128));
+        }
+    }
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    // default handler exits on error, parameters below are always valid
+    cinfo.err = jpeg_std_error(std::addressof(jerr));
+    jpeg_create_compress(std::addressof(cinfo));
+    unsigned char* buf = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(std::addressof(cinfo), std::addressof(buf), std::addressof(size));
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(std::addressof(cinfo));
+    jpeg_set_quality(std::addressof(cinfo), 90, TRUE);
+    jpeg_start_compress(std::addressof(cinfo), TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = reinterpret_cast<JSAMPROW>(std::addressof(raw[cinfo.next_scanline * width * 3]));
+        jpeg_write_scanlines(std::addressof(cinfo), std::addressof(row), 1);
+    }
+    jpeg_finish_compress(std::addressof(cinfo));
+    auto res = std::string(reinterpret_cast<const char*>(buf), static_cast<size_t>(size));
+    jpeg_destroy_compress(std::addressof(cinfo));
+    std::free(buf);
+    return res;
+}
+
+struct bench_case {
+    std::string name;
+    // prepares new document for the case, returns context string passed to calls
+    std::function<std::string(const std::string&)> setup;
+    // returns call name and input for the specified document, context, thread and iteration
+    std::function<std::pair<std::string, std::string>(const std::string&, const std::string&, size_t, size_t)> next;
+    // runs measured calls without a prepared document
+    std::function<void()> standalone;
+    // same image drawn again into the document is served by deduplication,
+    // image cases use new document for every call to measure loading
+    bool document_per_call = false;
+};
+
+std::string create_document() {
+    return json_field(call("pdf_create_document", "{}"), "pdfDocumentHandle");
+}
+
+void destroy_document(const std::string& handle) {
+    call("pdf_destroy_document", "{\"pdfDocumentHandle\": " + handle + "}");
+}
+
+std::string add_page(const std::string& handle) {
+    call("pdf_add_page", "{\"pdfDocumentHandle\": " + handle + ", \"format\": \"A4\", \"orientation\": \"PORTRAIT\"}");
+    return std::string();
+}
+
+std::string load_font(const std::string& handle, const std::string& font_path) {
+    auto out = call("pdf_load_font", "{\"pdfDocumentHandle\": " + handle +
+            ", \"ttfPath\": \"" + escape_path(font_path) + "\"}");
+    return json_field(out, "fontName");
+}
+
+struct case_result {
+    std::string name;
+    size_t calls = 0;
+    double seconds = 0;
+    std::vector<uint64_t> latencies_nanos;
+    uint64_t allocations = 0;
+    std::string error;
+};
+
+case_result run_case(const bench_case& bc, const bench_options& opts) {
+    auto results = std::vector<case_result>(opts.threads);
+    auto threads = std::vector<std::thread>();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < opts.threads; t++) {
+        threads.emplace_back([&bc, &opts, &results, t]() {
+            auto& res = results[t];
+            res.latencies_nanos.reserve(opts.iterations);
+            auto handle = std::string();
+            auto ctx = std::string();
+            size_t per_document = bc.document_per_call ? 1 : opts.calls_per_document;
+            try {
+                for (size_t i = 0; i < opts.iterations; i++) {
+                    if (!bc.standalone && (handle.empty() || 0 == i % per_document)) {
+                        if (!handle.empty()) {
+                            destroy_document(handle);
+                        }
+                        handle = create_document();
+                        ctx = bc.setup(handle);
+                    }
+                    auto call_start = std::chrono::steady_clock::now();
+                    auto allocs_start = thread_allocations;
+                    if (!bc.standalone) {
+                        auto cl = bc.next(handle, ctx, t, i);
+                        call_start = std::chrono::steady_clock::now();
+                        allocs_start = thread_allocations;
+                        call(cl.first, cl.second);
+                    } else {
+                        bc.standalone();
+                    }
+                    auto call_end = std::chrono::steady_clock::now();
+                    res.allocations += thread_allocations - allocs_start;
+                    res.latencies_nanos.push_back(static_cast<uint64_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(call_end - call_start).count()));
+                }
+                if (!handle.empty()) {
+                    destroy_document(handle);
+                }
+            } catch (const std::exception& e) {
+                res.error = e.what();
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto total = case_result();
+    total.name = bc.name;
+    total.seconds = std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+    for (auto& res : results) {
+        total.latencies_nanos.insert(total.latencies_nanos.end(),
+                res.latencies_nanos.begin(), res.latencies_nanos.end());
+        total.allocations += res.allocations;
+        if (total.error.empty() && !res.error.empty()) {
+            total.error = res.error;
+        }
+    }
+    total.calls = total.latencies_nanos.size();
+    std::sort(total.latencies_nanos.begin(), total.latencies_nanos.end());
+    return total;
+}
+
+uint64_t percentile_micros(const std::vector<uint64_t>& sorted, double pc) {
+    if (sorted.empty()) return 0;
+    size_t idx = static_cast<size_t>(pc * static_cast<double>(sorted.size() - 1));
+    return sorted[idx] / 1000;
+}
+
+std::string quote(const std::string& str) {
+    auto res = std::string("\"");
+    for (char ch : str) {
+        if ('"' == ch || '\\' == ch) {
+            res.push_back('\\');
+            res.push_back(ch);
+        } else if ('\n' == ch) {
+            res.append("\\n");
+        } else if (static_cast<unsigned char>(ch) >= 0x20) {
+            res.push_back(ch);
+        }
+    }
+    res.push_back('"');
+    return res;
+}
+
+std::vector<bench_case> make_cases(const bench_options& opts) {
+    auto cases = std::vector<bench_case>();
+    auto no_setup = [](const std::string&) { return std::string(); };
+    auto page_setup = [](const std::string& handle) { return add_page(handle); };
+
+    {
+        auto bc = bench_case();
+        bc.name = "create_destroy_document";
+        bc.standalone = [] {
+            destroy_document(create_document());
+        };
+        cases.push_back(bc);
+    }
+    {
+        auto bc = bench_case();
+        bc.name = "add_page";
+        bc.setup = no_setup;
+        bc.next = [](const std::string& handle, const std::string&, size_t, size_t) {
+            return std::make_pair(std::string("pdf_add_page"), "{\"pdfDocumentHandle\": " + handle +
+                    ", \"format\": \"A4\", \"orientation\": \"PORTRAIT\"}");
+        };
+        cases.push_back(bc);
+    }
+    {
+        auto bc = bench_case();
+        bc.name = "draw_line";
+        bc.setup = page_setup;
+        bc.next = [](const std::string& handle, const std::string&, size_t, size_t i) {
+            auto off = std::to_string(i % 500);
+            return std::make_pair(std::string("pdf_draw_line"), "{\"pdfDocumentHandle\": " + handle +
+                    ", \"beginX\": 10, \"beginY\": " + off + ", \"endX\": 500, \"endY\": " + off +
+                    ", \"lineWidth\": 1.5, \"color\": {\"r\": 0.1, \"g\": 0.2, \"b\": 0.3}}");
+        };
+        cases.push_back(bc);
+    }
+    {
+        auto bc = bench_case();
+        bc.name = "draw_rectangle";
+        bc.setup = page_setup;
+        bc.next = [](const std::string& handle, const std::string&, size_t, size_t i) {
+            auto off = std::to_string(i % 500);
+            return std::make_pair(std::string("pdf_draw_rectangle"), "{\"pdfDocumentHandle\": " + handle +
+                    ", \"x\": 10, \"y\": " + off + ", \"width\": 100, \"height\": 20" +
+                    ", \"lineWidth\": 1.0, \"color\": {\"r\": 0.5, \"g\": 0.5, \"b\": 0.5}}");
+        };
+        cases.push_back(bc);
+    }
+    {
+        auto font_path = opts.font_path;
+        {
+            auto bc = bench_case();
+            bc.name = "load_font";
+            bc.setup = no_setup;
+            bc.next = [font_path](const std::string& handle, const std::string&, size_t, size_t) {
+                return std::make_pair(std::string("pdf_load_font"), "{\"pdfDocumentHandle\": " + handle +
+                        ", \"ttfPath\": \"" + escape_path(font_path) + "\"}");
+            };
+            cases.push_back(bc);
+        }
+        auto font_setup = [font_path](const std::string& handle) {
+            add_page(handle);
+            return load_font(handle, font_path);
+        };
+        {
+            auto bc = bench_case();
+            bc.name = "write_text";
+            bc.setup = font_setup;
+            bc.next = [](const std::string& handle, const std::string& font, size_t, size_t i) {
+                return std::make_pair(std::string("pdf_write_text"), "{\"pdfDocumentHandle\": " + handle +
+                        ", \"text\": \"Benchmark text line " + std::to_string(i) + "\"" +
+                        ", \"x\": 20, \"y\": " + std::to_string(i % 700) +
+                        ", \"fontName\": \"" + font + "\", \"fontSize\": 12" +
+                        ", \"color\": {\"r\": 0, \"g\": 0, \"b\": 0}}");
+            };
+            cases.push_back(bc);
+        }
+        {
+            auto bc = bench_case();
+            bc.name = "write_text_inside_rectangle";
+            bc.setup = font_setup;
+            bc.next = [](const std::string& handle, const std::string& font, size_t, size_t i) {
+                return std::make_pair(std::string("pdf_write_text_inside_rectangle"), "{\"pdfDocumentHandle\": " + handle +
+                        ", \"text\": \"Benchmark paragraph text that is long enough to be wrapped" +
+                        " inside the rectangle more than once " + std::to_string(i) + "\"" +
+                        ", \"left\": 20, \"top\": 700, \"right\": 300, \"bottom\": 600" +
+                        ", \"align\": \"JUSTIFY\", \"fontName\": \"" + font + "\", \"fontSize\": 10" +
+                        ", \"color\": {\"r\": 0, \"g\": 0, \"b\": 0}}");
+            };
+            cases.push_back(bc);
+        }
+    }
+
+    auto png_path = opts.out_dir + "/wilton_pdf_bench.png";
+    write_file(png_path, synthetic_png(256, 256));
+    auto jpeg_path = opts.jpeg_path;
+    if (jpeg_path.empty()) {
+        jpeg_path = opts.out_dir + "/wilton_pdf_bench.jpg";
+        write_file(jpeg_path, synthetic_jpeg(256, 256));
+    }
+    auto images = std::vector<std::pair<std::string, std::string>>();
+    images.emplace_back("PNG", png_path);
+    images.emplace_back("JPEG", jpeg_path);
+    for (auto& im : images) {
+        auto format = im.first;
+        auto path = im.second;
+        auto data = read_file(path);
+        auto hex = to_hex(data);
+        auto base64 = to_base64(data);
+        auto lower = format == "PNG" ? std::string("png") : std::string("jpeg");
+        {
+            auto bc = bench_case();
+            bc.name = "draw_image_" + lower + "_hex";
+            bc.setup = page_setup;
+            bc.document_per_call = true;
+            bc.next = [format, hex](const std::string& handle, const std::string&, size_t, size_t) {
+                return std::make_pair(std::string("pdf_draw_image"), "{\"pdfDocumentHandle\": " + handle +
+                        ", \"imageHex\": \"" + hex + "\", \"imageFormat\": \"" + format + "\"" +
+                        ", \"x\": 50, \"y\": 50, \"width\": 100, \"height\": 100}");
+            };
+            cases.push_back(bc);
+        }
+        {
+            auto bc = bench_case();
+            bc.name = "draw_image_" + lower + "_base64";
+            bc.setup = page_setup;
+            bc.document_per_call = true;
+            bc.next = [format, base64](const std::string& handle, const std::string&, size_t, size_t) {
+                return std::make_pair(std::string("pdf_draw_image"), "{\"pdfDocumentHandle\": " + handle +
+                        ", \"imageBase64\": \"" + base64 + "\", \"imageFormat\": \"" + format + "\"" +
+                        ", \"x\": 50, \"y\": 50, \"width\": 100, \"height\": 100}");
+            };
+            cases.push_back(bc);
+        }
+        {
+            auto bc = bench_case();
+            bc.name = "draw_image_" + lower + "_buffer";
+            bc.setup = page_setup;
+            bc.document_per_call = true;
+            auto reg = call("pdf_register_buffer", "{\"path\": \"" + escape_path(path) + "\"}");
+            auto buffer_id = json_field(reg, "bufferId");
+            bc.next = [format, buffer_id](const std::string& handle, const std::string&, size_t, size_t) {
+                return std::make_pair(std::string("pdf_draw_image"), "{\"pdfDocumentHandle\": " + handle +
+                        ", \"bufferId\": " + buffer_id + ", \"imageFormat\": \"" + format + "\"" +
+                        ", \"x\": 50, \"y\": 50, \"width\": 100, \"height\": 100}");
+            };
+            cases.push_back(bc);
+        }
+        {
+            auto bc = bench_case();
+            bc.name = "draw_image_" + lower + "_path";
+            bc.setup = page_setup;
+            bc.document_per_call = true;
+            bc.next = [format, path](const std::string& handle, const std::string&, size_t, size_t) {
+                return std::make_pair(std::string("pdf_draw_image"), "{\"pdfDocumentHandle\": " + handle +
+                        ", \"imagePath\": \"" + escape_path(path) + "\", \"imageFormat\": \"" + format + "\"" +
+                        ", \"x\": 50, \"y\": 50, \"width\": 100, \"height\": 100}");
+            };
+            cases.push_back(bc);
+        }
+        {
+            auto draw_input = [format, hex](const std::string& handle) {
+                return "{\"pdfDocumentHandle\": " + handle +
+                        ", \"imageHex\": \"" + hex + "\", \"imageFormat\": \"" + format + "\"" +
+                        ", \"x\": 50, \"y\": 50, \"width\": 100, \"height\": 100}";
+            };
+            auto bc = bench_case();
+            bc.name = "draw_image_" + lower + "_dedup_hit";
+            // image is loaded by setup, measured calls find it already loaded
+            bc.setup = [draw_input](const std::string& handle) {
+                add_page(handle);
+                call("pdf_draw_image", draw_input(handle));
+                return std::string();
+            };
+            bc.next = [draw_input](const std::string& handle, const std::string&, size_t, size_t) {
+                return std::make_pair(std::string("pdf_draw_image"), draw_input(handle));
+            };
+            cases.push_back(bc);
+        }
+    }
+
+    {
+        auto out_dir = opts.out_dir;
+        auto bc = bench_case();
+        bc.name = "save_to_file";
+        bc.setup = [](const std::string& handle) {
+            add_page(handle);
+            for (int i = 0; i < 100; i++) {
+                call("pdf_draw_line", "{\"pdfDocumentHandle\": " + handle +
+                        ", \"beginX\": 10, \"beginY\": " + std::to_string(i * 7) +
+                        ", \"endX\": 500, \"endY\": " + std::to_string(i * 7) +
+                        ", \"lineWidth\": 1, \"color\": {\"r\": 0, \"g\": 0, \"b\": 0}}");
+            }
+            return std::string();
+        };
+        bc.next = [out_dir](const std::string& handle, const std::string&, size_t t, size_t) {
+            auto path = out_dir + "/wilton_pdf_bench_" + std::to_string(t) + ".pdf";
+            return std::make_pair(std::string("pdf_save_to_file"), "{\"pdfDocumentHandle\": " + handle +
+                    ", \"path\": \"" + escape_path(path) + "\"}");
+        };
+        cases.push_back(bc);
+    }
+    return cases;
+}
+
+bench_options parse_options(int argc, char** argv) {
+    auto opts = bench_options();
+    for (int i = 1; i < argc; i++) {
+        auto arg = std::string(argv[i]);
+        if (i + 1 >= argc) throw std::runtime_error("Missing value for option: [" + arg + "]");
+        auto val = std::string(argv[++i]);
+        if ("--threads" == arg) {
+            opts.threads = std::strtoul(val.c_str(), nullptr, 10);
+        } else if ("--iterations" == arg) {
+            opts.iterations = std::strtoul(val.c_str(), nullptr, 10);
+        } else if ("--calls-per-document" == arg) {
+            opts.calls_per_document = std::strtoul(val.c_str(), nullptr, 10);
+        } else if ("--font" == arg) {
+            opts.font_path = val;
+        } else if ("--jpeg" == arg) {
+            opts.jpeg_path = val;
+        } else if ("--out-dir" == arg) {
+            opts.out_dir = val;
+        } else if ("--config" == arg) {
+            opts.config = val;
+        } else throw std::runtime_error("Unknown option: [" + arg + "]");
+    }
+    if (0 == opts.threads || 0 == opts.iterations || 0 == opts.calls_per_document) {
+        throw std::runtime_error("Invalid zero option value specified");
+    }
+    return opts;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        auto opts = parse_options(argc, argv);
+        init_module(opts.config);
+        auto cases = make_cases(opts);
+        std::cout << "{" << std::endl;
+        std::cout << "    \"threads\": " << opts.threads << "," << std::endl;
+        std::cout << "    \"callsPerThread\": " << opts.iterations << "," << std::endl;
+        std::cout << "    \"cases\": [" << std::endl;
+        for (size_t i = 0; i < cases.size(); i++) {
+            auto res = run_case(cases[i], opts);
+            std::cout << "        {" << std::endl;
+            std::cout << "            \"name\": " << quote(res.name) << "," << std::endl;
+            std::cout << "            \"calls\": " << res.calls << "," << std::endl;
+            std::cout << "            \"callsPerSecond\": " << static_cast<int64_t>(
+                    static_cast<double>(res.calls) / (res.seconds > 0 ? res.seconds : 1)) << "," << std::endl;
+            std::cout << "            \"p50Micros\": " << percentile_micros(res.latencies_nanos, 0.5) << "," << std::endl;
+            std::cout << "            \"p90Micros\": " << percentile_micros(res.latencies_nanos, 0.9) << "," << std::endl;
+            std::cout << "            \"p99Micros\": " << percentile_micros(res.latencies_nanos, 0.99) << "," << std::endl;
+            std::cout << "            \"maxMicros\": " << percentile_micros(res.latencies_nanos, 1.0) << "," << std::endl;
+            std::cout << "            \"allocationsPerCall\": " << (res.calls > 0 ?
+                    static_cast<double>(res.allocations) / static_cast<double>(res.calls) : 0) << "," << std::endl;
+            std::cout << "            \"error\": " << quote(res.error) << std::endl;
+            std::cout << "        }" << (i + 1 < cases.size() ? "," : "") << std::endl;
+        }
+        std::cout << "    ]" << std::endl;
+        std::cout << "}" << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,433 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   pdf_replay.cpp
+ * Author: alex
+ *
+ * Created on November 17, 2020, 6:52 PM
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "staticlib/json.hpp"
+
+#include "wiltoncall_client.hpp"
+
+namespace { // anonymous
+
+const std::string blob_prefix = "@blob:";
+
+struct replay_options {
+    std::string log_path;
+    size_t replicas = 1;
+    bool original_timing = false;
+    std::string config = wiltoncall_default_config;
+};
+
+struct log_entry {
+    int64_t t = 0;
+    std::string thread;
+    std::string call;
+    sl::json::value input;
+    sl::json::value output;
+    bool failed = false;
+    // recorded handles used in input, mapped to the slots of the calls that created them
+    std::unordered_map<int64_t, size_t> used;
+    // output fields with created handles and their slots
+    std::vector<std::pair<std::string, size_t>> created;
+};
+
+struct call_result {
+    std::string call;
+    uint64_t nanos = 0;
+};
+
+struct replica_result {
+    std::vector<call_result> calls;
+    size_t expected_errors = 0;
+    size_t errors = 0;
+    std::string first_error;
+};
+
+/**
+ * Handles created during replay, handle created on one thread
+ * is waited for by the calls of other threads that use it
+ */
+class handle_slots {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<int64_t> values;
+    std::vector<bool> filled;
+
+public:
+    explicit handle_slots(size_t count) :
+    values(count, -1),
+    filled(count, false) { }
+
+    void put(size_t slot, int64_t value) {
+        {
+            std::lock_guard<std::mutex> guard{mtx};
+            values[slot] = value;
+            filled[slot] = true;
+        }
+        cv.notify_all();
+    }
+
+    int64_t get(size_t slot) {
+        std::unique_lock<std::mutex> guard{mtx};
+        cv.wait(guard, [this, slot] {
+            return filled[slot];
+        });
+        return values[slot];
+    }
+};
+
+bool is_handle_field(const std::string& name) {
+    return "pdfDocumentHandle" == name || "pdfTemplateHandle" == name || "bufferId" == name;
+}
+
+void resolve_blobs(sl::json::value& json, const std::unordered_map<std::string, std::string>& blobs) {
+    if (sl::json::type::object == json.json_type()) {
+        for (sl::json::field& fi : json.as_object_or_throw()) {
+            if (sl::json::type::string == fi.json_type() &&
+                    0 == fi.val().as_string().compare(0, blob_prefix.length(), blob_prefix)) {
+                auto hash = fi.val().as_string().substr(blob_prefix.length());
+                auto it = blobs.find(hash);
+                if (blobs.end() == it) throw std::runtime_error("Blob not found, hash: [" + hash + "]");
+                fi.val() = sl::json::value(it->second);
+            } else {
+                resolve_blobs(fi.val(), blobs);
+            }
+        }
+    } else if (sl::json::type::array == json.json_type()) {
+        for (auto& el : json.as_array_or_throw()) {
+            resolve_blobs(el, blobs);
+        }
+    }
+}
+
+// handles are pointer values and are reused after destroy,
+// use refers to the latest creation of the same value
+void link_used_handles(const sl::json::value& json, const std::unordered_map<int64_t, size_t>& latest,
+        std::unordered_map<int64_t, size_t>& used) {
+    if (sl::json::type::object == json.json_type()) {
+        for (const sl::json::field& fi : json.as_object()) {
+            if (is_handle_field(fi.name()) && sl::json::type::integer == fi.json_type()) {
+                auto it = latest.find(fi.val().as_int64());
+                if (latest.end() != it) {
+                    used[it->first] = it->second;
+                }
+            } else {
+                link_used_handles(fi.val(), latest, used);
+            }
+        }
+    } else if (sl::json::type::array == json.json_type()) {
+        for (auto& el : json.as_array()) {
+            link_used_handles(el, latest, used);
+        }
+    }
+}
+
+// returns number of slots for created handles
+size_t link_handles(std::vector<log_entry>& entries) {
+    auto latest = std::unordered_map<int64_t, size_t>();
+    size_t slots = 0;
+    for (auto& en : entries) {
+        link_used_handles(en.input, latest, en.used);
+        if (sl::json::type::object != en.output.json_type()) {
+            continue;
+        }
+        for (const sl::json::field& fi : en.output.as_object()) {
+            if (is_handle_field(fi.name()) && sl::json::type::integer == fi.json_type()) {
+                latest[fi.val().as_int64()] = slots;
+                en.created.emplace_back(fi.name(), slots);
+                slots += 1;
+            }
+        }
+    }
+    return slots;
+}
+
+// recorded handles are replaced with the ones created during replay
+void map_handles(sl::json::value& json, const log_entry& en, handle_slots& slots) {
+    if (sl::json::type::object == json.json_type()) {
+        for (sl::json::field& fi : json.as_object_or_throw()) {
+            if (is_handle_field(fi.name()) && sl::json::type::integer == fi.json_type()) {
+                auto it = en.used.find(fi.val().as_int64());
+                if (en.used.end() != it) {
+                    fi.val() = sl::json::value(slots.get(it->second));
+                }
+            } else {
+                map_handles(fi.val(), en, slots);
+            }
+        }
+    } else if (sl::json::type::array == json.json_type()) {
+        for (auto& el : json.as_array_or_throw()) {
+            map_handles(el, en, slots);
+        }
+    }
+}
+
+// slots are filled on failure too, so waiting calls
+// proceed with the recorded handle and fail
+void fill_slots(const log_entry& en, const std::string& actual, handle_slots& slots) {
+    auto actual_json = sl::json::value();
+    if (!actual.empty()) {
+        try {
+            actual_json = sl::json::load(actual);
+        } catch (const std::exception&) {
+            // recorded handles are used
+        }
+    }
+    bool is_object = sl::json::type::object == actual_json.json_type();
+    for (auto& cr : en.created) {
+        int64_t handle = en.output[cr.first].as_int64();
+        if (is_object && sl::json::type::integer == actual_json[cr.first].json_type()) {
+            handle = actual_json[cr.first].as_int64();
+        }
+        slots.put(cr.second, handle);
+    }
+}
+
+std::vector<log_entry> load_log(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open()) throw std::runtime_error("Error opening log file, path: [" + path + "]");
+    auto blobs = std::unordered_map<std::string, std::string>();
+    auto entries = std::vector<log_entry>();
+    auto line = std::string();
+    while (std::getline(stream, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        auto json = sl::json::load(line);
+        auto en = log_entry();
+        bool is_blob = false;
+        for (sl::json::field& fi : json.as_object_or_throw()) {
+            auto& name = fi.name();
+            if ("blob" == name) {
+                blobs[fi.as_string_or_throw(name)] = json["data"].as_string();
+                is_blob = true;
+                break;
+            } else if ("t" == name) {
+                en.t = fi.as_int64_or_throw(name);
+            } else if ("thread" == name) {
+                en.thread = fi.as_string_or_throw(name);
+            } else if ("call" == name) {
+                en.call = fi.as_string_nonempty_or_throw(name);
+            } else if ("input" == name) {
+                en.input = std::move(fi.val());
+            } else if ("output" == name) {
+                en.output = std::move(fi.val());
+            } else if ("error" == name) {
+                en.failed = true;
+            }
+        }
+        if (!is_blob) {
+            entries.emplace_back(std::move(en));
+        }
+    }
+    for (auto& en : entries) {
+        resolve_blobs(en.input, blobs);
+    }
+    // calls from different threads are logged in completion order
+    std::stable_sort(entries.begin(), entries.end(), [](const log_entry& a, const log_entry& b) {
+        return a.t < b.t;
+    });
+    return entries;
+}
+
+// calls of every recorded thread, in recorded order
+std::vector<std::vector<const log_entry*>> partition_by_thread(const std::vector<log_entry>& entries) {
+    auto res = std::vector<std::vector<const log_entry*>>();
+    auto indices = std::unordered_map<std::string, size_t>();
+    for (auto& en : entries) {
+        auto it = indices.find(en.thread);
+        if (indices.end() == it) {
+            it = indices.emplace(en.thread, res.size()).first;
+            res.emplace_back();
+        }
+        res[it->second].push_back(std::addressof(en));
+    }
+    return res;
+}
+
+replica_result replay(const std::vector<const log_entry*>& entries, handle_slots& slots,
+        std::chrono::steady_clock::time_point start, bool original_timing) {
+    auto res = replica_result();
+    res.calls.reserve(entries.size());
+    for (auto en_ptr : entries) {
+        auto& en = *en_ptr;
+        if (original_timing) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(en.t));
+        }
+        auto input = en.input.clone();
+        map_handles(input, en, slots);
+        auto input_str = sl::json::type::nullt == input.json_type() ? std::string() : input.dumps();
+        auto call_start = std::chrono::steady_clock::now();
+        auto output = std::string();
+        try {
+            output = call(en.call, input_str);
+        } catch (const std::exception& e) {
+            if (en.failed) {
+                res.expected_errors += 1;
+            } else {
+                res.errors += 1;
+                if (res.first_error.empty()) {
+                    res.first_error = e.what();
+                }
+            }
+        }
+        auto call_end = std::chrono::steady_clock::now();
+        auto cr = call_result();
+        cr.call = en.call;
+        cr.nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                call_end - call_start).count());
+        res.calls.push_back(cr);
+        fill_slots(en, output, slots);
+    }
+    return res;
+}
+
+uint64_t percentile_micros(const std::vector<uint64_t>& sorted, double pc) {
+    if (sorted.empty()) return 0;
+    size_t idx = static_cast<size_t>(pc * static_cast<double>(sorted.size() - 1));
+    return sorted[idx] / 1000;
+}
+
+sl::json::value latency_json(std::vector<uint64_t>& nanos, double seconds) {
+    std::sort(nanos.begin(), nanos.end());
+    return {
+        { "calls", static_cast<int64_t>(nanos.size()) },
+        { "callsPerSecond", static_cast<int64_t>(static_cast<double>(nanos.size()) / (seconds > 0 ? seconds : 1)) },
+        { "p50Micros", static_cast<int64_t>(percentile_micros(nanos, 0.5)) },
+        { "p90Micros", static_cast<int64_t>(percentile_micros(nanos, 0.9)) },
+        { "p99Micros", static_cast<int64_t>(percentile_micros(nanos, 0.99)) },
+        { "maxMicros", static_cast<int64_t>(percentile_micros(nanos, 1.0)) }
+    };
+}
+
+replay_options parse_options(int argc, char** argv) {
+    auto opts = replay_options();
+    for (int i = 1; i < argc; i++) {
+        auto arg = std::string(argv[i]);
+        if ("--original-timing" == arg) {
+            opts.original_timing = true;
+            continue;
+        }
+        if (i + 1 >= argc) throw std::runtime_error("Missing value for option: [" + arg + "]");
+        auto val = std::string(argv[++i]);
+        if ("--log" == arg) {
+            opts.log_path = val;
+        } else if ("--replicas" == arg) {
+            opts.replicas = std::strtoul(val.c_str(), nullptr, 10);
+        } else if ("--config" == arg) {
+            opts.config = val;
+        } else throw std::runtime_error("Unknown option: [" + arg + "]");
+    }
+    if (opts.log_path.empty()) throw std::runtime_error("Required option '--log' not specified");
+    if (0 == opts.replicas) throw std::runtime_error("Invalid zero '--replicas' value specified");
+    return opts;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        auto opts = parse_options(argc, argv);
+        auto entries = load_log(opts.log_path);
+        size_t slots_count = link_handles(entries);
+        auto partitions = partition_by_thread(entries);
+        init_module(opts.config);
+        // every replica replays the whole log with its own handles,
+        // calls of every recorded thread are replayed on a separate thread
+        auto slots = std::vector<std::unique_ptr<handle_slots>>();
+        for (size_t r = 0; r < opts.replicas; r++) {
+            slots.emplace_back(new handle_slots(slots_count));
+        }
+        auto results = std::vector<replica_result>(opts.replicas * partitions.size());
+        auto threads = std::vector<std::thread>();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < opts.replicas; r++) {
+            for (size_t p = 0; p < partitions.size(); p++) {
+                auto& res = results[r * partitions.size() + p];
+                auto& part = partitions[p];
+                auto& hs = *slots[r];
+                threads.emplace_back([&res, &part, &hs, &opts, start] {
+                    res = replay(part, hs, start, opts.original_timing);
+                });
+            }
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+
+        auto all = std::vector<uint64_t>();
+        auto by_call = std::map<std::string, std::vector<uint64_t>>();
+        size_t expected_errors = 0;
+        size_t errors = 0;
+        auto first_error = std::string();
+        for (auto& res : results) {
+            for (auto& cr : res.calls) {
+                all.push_back(cr.nanos);
+                by_call[cr.call].push_back(cr.nanos);
+            }
+            expected_errors += res.expected_errors;
+            errors += res.errors;
+            if (first_error.empty()) {
+                first_error = res.first_error;
+            }
+        }
+        auto calls_json = std::vector<sl::json::field>();
+        for (auto& en : by_call) {
+            calls_json.emplace_back(en.first, latency_json(en.second, seconds));
+        }
+        auto report = sl::json::value({
+            { "replicas", static_cast<int64_t>(opts.replicas) },
+            { "recordedThreads", static_cast<int64_t>(partitions.size()) },
+            { "loggedCalls", static_cast<int64_t>(entries.size()) },
+            { "originalTiming", opts.original_timing },
+            { "seconds", seconds },
+            { "total", latency_json(all, seconds) },
+            { "calls", std::move(calls_json) },
+            { "expectedErrors", static_cast<int64_t>(expected_errors) },
+            { "errors", static_cast<int64_t>(errors) },
+            { "firstError", first_error }
+        });
+        std::cout << report.dumps() << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+}
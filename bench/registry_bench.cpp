@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   registry_bench.cpp
+ * Author: alex
+ *
+ * Created on October 22, 2020, 10:03 PM
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sharded_handle_registry.hpp"
+
+namespace { // anonymous
+
+struct dummy_doc {
+    int64_t counter = 0;
+};
+
+// every thread works with its own documents, the same way
+// as the wiltoncalls do: look up, work
+double run(size_t shards, size_t threads_count, size_t docs_per_thread, size_t iterations) {
+    wilton::pdf::sharded_handle_registry<dummy_doc> reg(shards);
+    auto threads = std::vector<std::thread>();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads_count; t++) {
+        threads.emplace_back([&reg, docs_per_thread, iterations]() {
+            auto handles = std::vector<int64_t>();
+            for (size_t i = 0; i < docs_per_thread; i++) {
+                handles.push_back(reg.put(std::make_shared<dummy_doc>()));
+            }
+            for (size_t i = 0; i < iterations; i++) {
+                auto handle = handles[i % handles.size()];
+                auto doc = reg.peek(handle);
+                if (nullptr == doc.get()) {
+                    std::cerr << "ERROR: handle lost: [" << handle << "]" << std::endl;
+                    std::exit(1);
+                }
+                doc->counter += 1;
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    double calls = static_cast<double>(threads_count * iterations);
+    return calls / (static_cast<double>(millis > 0 ? millis : 1) / 1000);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 32;
+    size_t iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+    size_t docs = 4;
+    double single = run(1, threads, docs, iterations);
+    double sharded = run(0, threads, docs, iterations);
+    std::cout << "{" << std::endl;
+    std::cout << "    \"threads\": " << threads << "," << std::endl;
+    std::cout << "    \"callsPerThread\": " << iterations << "," << std::endl;
+    std::cout << "    \"singleLockCallsPerSecond\": " << static_cast<int64_t>(single) << "," << std::endl;
+    std::cout << "    \"shardedCallsPerSecond\": " << static_cast<int64_t>(sharded) << std::endl;
+    std::cout << "}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   wiltoncall_client.hpp
+ * Author: alex
+ *
+ * Created on November 16, 2020, 9:27 PM
+ */
+
+#ifndef WILTON_PDF_BENCH_WILTONCALL_CLIENT_HPP
+#define WILTON_PDF_BENCH_WILTONCALL_CLIENT_HPP
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "wilton/wilton.h"
+#include "wilton/wiltoncall.h"
+
+extern "C" char* wilton_module_init();
+
+namespace { // anonymous
+
+// wiltoncall_init config, can be overridden with '--config'
+const std::string wiltoncall_default_config = R"({
+    "defaultScriptEngine": "duktape",
+    "wiltonHome": "./",
+    "applicationDirectory": "./",
+    "environmentVariables": {},
+    "requireJs": {
+        "waitSeconds": 0,
+        "enforceDefine": true,
+        "nodeIdCompat": true,
+        "baseUrl": "./",
+        "paths": {},
+        "packages": []
+    }
+})";
+
+std::string call(const std::string& name, const std::string& input) {
+    char* out = nullptr;
+    int out_len = 0;
+    char* err = wiltoncall(name.c_str(), static_cast<int>(name.length()),
+            input.c_str(), static_cast<int>(input.length()),
+            std::addressof(out), std::addressof(out_len));
+    if (nullptr != err) {
+        auto msg = std::string(err);
+        wilton_free(err);
+        throw std::runtime_error("Call error, name: [" + name + "], input: [" +
+                input.substr(0, 256) + "], message: [" + msg + "]");
+    }
+    auto res = std::string();
+    if (nullptr != out) {
+        res.assign(out, static_cast<size_t>(out_len));
+        wilton_free(out);
+    }
+    return res;
+}
+
+void init_module(const std::string& config) {
+    auto err_init = wiltoncall_init(config.c_str(), static_cast<int>(config.length()));
+    if (nullptr != err_init) {
+        auto msg = std::string(err_init);
+        wilton_free(err_init);
+        throw std::runtime_error("'wiltoncall_init' error: [" + msg + "]");
+    }
+    auto err_module = wilton_module_init();
+    if (nullptr != err_module) {
+        auto msg = std::string(err_module);
+        wilton_free(err_module);
+        throw std::runtime_error("'wilton_module_init' error: [" + msg + "]");
+    }
+}
+
+} // namespace
+
+#endif /* WILTON_PDF_BENCH_WILTONCALL_CLIENT_HPP */
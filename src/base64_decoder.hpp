@@ -0,0 +1,181 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   base64_decoder.hpp
+ * Author: alex
+ *
+ * Created on November 24, 2020, 3:15 PM
+ */
+
+#ifndef WILTON_PDF_BASE64_DECODER_HPP
+#define WILTON_PDF_BASE64_DECODER_HPP
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WILTON_PDF_BASE64_SSSE3
+#define WILTON_PDF_BASE64_SSSE3_TARGET __attribute__((target("ssse3")))
+#include <tmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define WILTON_PDF_BASE64_SSSE3
+#define WILTON_PDF_BASE64_SSSE3_TARGET
+#include <intrin.h>
+#include <tmmintrin.h>
+#endif // SSSE3
+
+#include "staticlib/io.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+namespace wilton {
+namespace pdf {
+
+namespace base64_detail {
+
+// sextet values, -1 for chars outside of the standard alphabet
+inline const std::array<int8_t, 256>& decode_table() {
+    static const std::array<int8_t, 256> table = [] {
+        auto res = std::array<int8_t, 256>();
+        res.fill(-1);
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; i++) {
+            res[static_cast<unsigned char>(alphabet[i])] = static_cast<int8_t>(i);
+        }
+        return res;
+    } ();
+    return table;
+}
+
+inline void throw_invalid_char(const char* b64, size_t pos) {
+    throw support::exception(TRACEMSG("Invalid base64 char specified," +
+            " position: [" + sl::support::to_string(pos) + "]," +
+            " code: [" + sl::support::to_string(static_cast<int>(static_cast<unsigned char>(b64[pos]))) + "]"));
+}
+
+// decodes from the specified position to the end, input length
+// must not include padding, throws on invalid char
+inline void decode_scalar(const char* b64, size_t len, size_t from, char* out) {
+    auto& table = decode_table();
+    uint32_t acc = 0;
+    int bits = 0;
+    char* dest = out + (from / 4) * 3;
+    for (size_t i = from; i < len; i++) {
+        int8_t val = table[static_cast<unsigned char>(b64[i])];
+        if (val < 0) {
+            throw_invalid_char(b64, i);
+        }
+        acc = (acc << 6) | static_cast<uint32_t>(val);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            *dest++ = static_cast<char>((acc >> bits) & 0xff);
+        }
+    }
+}
+
+#ifdef WILTON_PDF_BASE64_SSSE3
+
+inline bool cpu_has_ssse3() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return 0 != (info[2] & (1 << 9));
+#else
+    return 0 != __builtin_cpu_supports("ssse3");
+#endif
+}
+
+// 16 chars to 12 bytes per iteration, 4 extra bytes are written
+// after every block, so the last 8 chars are left to scalar loop;
+// returns number of chars decoded, stops before the first block with invalid chars
+WILTON_PDF_BASE64_SSSE3_TARGET
+inline size_t decode_ssse3(const char* b64, size_t len, char* out) {
+    // char classes by low and high nibbles, class bits intersect for invalid chars
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    // offsets from char to sextet by high nibble, '/' is a special case
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+            0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i merge_pairs = _mm_set1_epi32(0x01400140);
+    const __m128i merge_quads = _mm_set1_epi32(0x00011000);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 24 <= len; i += 16) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b64 + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), nibble_mask);
+        __m128i lo_nibbles = _mm_and_si128(chars, nibble_mask);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (0xffff != _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero))) {
+            break;
+        }
+        __m128i is_slash = _mm_cmpeq_epi8(chars, slash);
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(is_slash, hi_nibbles));
+        __m128i sextets = _mm_add_epi8(chars, roll);
+        __m128i pairs = _mm_maddubs_epi16(sextets, merge_pairs);
+        __m128i quads = _mm_madd_epi16(pairs, merge_quads);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + (i / 4) * 3), _mm_shuffle_epi8(quads, pack));
+    }
+    return i;
+}
+
+#endif // WILTON_PDF_BASE64_SSSE3
+
+} // namespace
+
+/**
+ * Decodes base64 string (standard alphabet, padding is optional) into
+ * a buffer allocated once, uses SSSE3 when CPU supports it
+ *
+ * @param b64 base64 string
+ * @return decoded bytes
+ */
+inline std::vector<char> decode_base64(sl::io::span<const char> b64) {
+    size_t len = b64.size();
+    if (0 == len % 4) {
+        for (size_t i = 0; i < 2 && len > 0 && '=' == b64.data()[len - 1]; i++) {
+            len -= 1;
+        }
+    }
+    if (1 == len % 4) throw support::exception(TRACEMSG(
+            "Invalid base64 data specified, length: [" + sl::support::to_string(b64.size()) + "]"));
+    auto res = std::vector<char>((len / 4) * 3 + (len % 4 > 0 ? len % 4 - 1 : 0));
+    size_t decoded = 0;
+#ifdef WILTON_PDF_BASE64_SSSE3
+    static const bool has_ssse3 = base64_detail::cpu_has_ssse3();
+    if (has_ssse3) {
+        decoded = base64_detail::decode_ssse3(b64.data(), len, res.data());
+    }
+#endif // WILTON_PDF_BASE64_SSSE3
+    // tail, or the rest after invalid block to find the invalid char
+    base64_detail::decode_scalar(b64.data(), len, decoded, res.data());
+    return res;
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_BASE64_DECODER_HPP */
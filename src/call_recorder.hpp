@@ -0,0 +1,225 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   call_recorder.hpp
+ * Author: alex
+ *
+ * Created on November 16, 2020, 8:03 PM
+ */
+
+#ifndef WILTON_PDF_CALL_RECORDER_HPP
+#define WILTON_PDF_CALL_RECORDER_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "staticlib/io.hpp"
+#include "staticlib/json.hpp"
+#include "staticlib/support.hpp"
+#include "staticlib/tinydir.hpp"
+
+#include "content_hash.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Writes calls to a log file, one JSON object per line:
+ *
+ * {"t": 123, "thread": "...", "call": "pdf_write_text", "input": {...}, "output": {...}, "error": "..."}
+ *
+ * 't' is the call start time in microseconds since the recording was started,
+ * 'output' is recorded only for calls that return handles. Inline image data
+ * is written once as {"blob": "<hash>", "data": "..."} and is referenced
+ * from the inputs as "@blob:<hash>", both hex and base64 inputs
+ * (including the ones of pdf_register_buffer) are handled this way.
+ * File inputs ('imagePath', 'ttfPath', 'path') are recorded as paths,
+ * file contents are not captured, so the replay host must have the same
+ * files under the same paths.
+ */
+class call_recorder {
+    std::mutex mtx;
+    std::unique_ptr<sl::tinydir::file_sink> sink;
+    std::unordered_set<std::string> blobs;
+    // changes when recording is restarted
+    uint64_t generation = 0;
+    std::chrono::steady_clock::time_point started;
+    std::atomic<bool> active;
+
+public:
+    call_recorder() :
+    active(false) { }
+
+    call_recorder(const call_recorder&) = delete;
+
+    call_recorder& operator=(const call_recorder&) = delete;
+
+    /**
+     * Starts recording into the specified file, previous recording is stopped
+     *
+     * @param path log file path, empty path stops recording
+     */
+    void start(const std::string& path) {
+        std::lock_guard<std::mutex> guard{mtx};
+        active.store(false, std::memory_order_release);
+        sink.reset();
+        blobs.clear();
+        generation += 1;
+        if (path.empty()) {
+            return;
+        }
+        sink = sl::support::make_unique<sl::tinydir::file_sink>(path);
+        started = std::chrono::steady_clock::now();
+        active.store(true, std::memory_order_release);
+    }
+
+    bool is_active() const {
+        return active.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Writes call to the log, errors are ignored, calls are not failed
+     * because of the recording
+     *
+     * @param call call name
+     * @param start call start time
+     * @param input call input
+     * @param output call output, written only if not empty
+     * @param error error message, written only if not empty
+     */
+    void record(const std::string& call, std::chrono::steady_clock::time_point start,
+            sl::io::span<const char> input, const std::string& output, const std::string& error) STATICLIB_NOEXCEPT {
+        try {
+            uint64_t gen = current_generation();
+            auto blob_lines = std::vector<std::pair<std::string, std::string>>();
+            auto input_str = prepare_input(input, blob_lines);
+            std::lock_guard<std::mutex> guard{mtx};
+            // blobs checked while preparing belong to other recording
+            if (nullptr == sink.get() || gen != generation) {
+                return;
+            }
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(start - started).count();
+            auto line = std::string();
+            // blob is marked as written together with writing it, so it is
+            // always written before any line, that references it
+            for (auto& bl : blob_lines) {
+                if (blobs.insert(bl.first).second) {
+                    line.append(bl.second);
+                }
+            }
+            line.append("{\"t\": ").append(sl::support::to_string(micros > 0 ? micros : 0));
+            line.append(", \"thread\": \"").append(sl::support::to_string(
+                    std::hash<std::thread::id>()(std::this_thread::get_id()))).append("\"");
+            line.append(", \"call\": \"").append(call).append("\"");
+            line.append(", \"input\": ").append(input_str);
+            if (!output.empty()) {
+                line.append(", \"output\": ").append(single_line(output));
+            }
+            if (!error.empty()) {
+                line.append(", \"error\": ").append(single_line(sl::json::value(error).dumps()));
+            }
+            line.append("}\n");
+            sl::io::write_all(*sink, {line.data(), line.length()});
+        } catch (...) {
+            // ignore
+        }
+    }
+
+private:
+    static std::string single_line(std::string str) {
+        // raw line breaks can only be whitespace in JSON text
+        std::replace(str.begin(), str.end(), '\n', ' ');
+        std::replace(str.begin(), str.end(), '\r', ' ');
+        return str;
+    }
+
+    // must be called without lock, blob lines are collected by hash
+    // and are built and written only if not written before
+    std::string prepare_input(sl::io::span<const char> input,
+            std::vector<std::pair<std::string, std::string>>& blob_lines) {
+        if (0 == input.size()) {
+            return "null";
+        }
+        if (!contains(input, "\"imageHex\"") && !contains(input, "\"imageBase64\"") &&
+                !contains(input, "\"hex\"") && !contains(input, "\"base64\"")) {
+            return single_line(std::string(input.data(), input.size()));
+        }
+        auto json = sl::json::load(input);
+        replace_blobs(json, blob_lines);
+        return single_line(json.dumps());
+    }
+
+    void replace_blobs(sl::json::value& json, std::vector<std::pair<std::string, std::string>>& blob_lines) {
+        if (sl::json::type::object == json.json_type()) {
+            for (sl::json::field& fi : json.as_object_or_throw()) {
+                if (is_blob_field(fi.name()) && sl::json::type::string == fi.json_type()) {
+                    auto& data = fi.val().as_string();
+                    auto hash = content_hash({data.data(), data.length()});
+                    if (!is_written(hash)) {
+                        auto bl = std::string();
+                        bl.append("{\"blob\": \"").append(hash).append("\", \"data\": ");
+                        bl.append(single_line(sl::json::value(data).dumps())).append("}\n");
+                        blob_lines.emplace_back(hash, std::move(bl));
+                    }
+                    fi.val() = sl::json::value("@blob:" + hash);
+                } else {
+                    replace_blobs(fi.val(), blob_lines);
+                }
+            }
+        } else if (sl::json::type::array == json.json_type()) {
+            for (auto& el : json.as_array_or_throw()) {
+                replace_blobs(el, blob_lines);
+            }
+        }
+    }
+
+    uint64_t current_generation() {
+        std::lock_guard<std::mutex> guard{mtx};
+        return generation;
+    }
+
+    // blob may be written by other thread after this check,
+    // it is checked again when the line is written
+    bool is_written(const std::string& hash) {
+        std::lock_guard<std::mutex> guard{mtx};
+        return blobs.count(hash) > 0;
+    }
+
+    static bool contains(sl::io::span<const char> input, const std::string& marker) {
+        auto end = input.data() + input.size();
+        return end != std::search(input.data(), end, marker.begin(), marker.end());
+    }
+
+    static bool is_blob_field(const std::string& name) {
+        return "imageHex" == name || "imageBase64" == name || "hex" == name || "base64" == name;
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_CALL_RECORDER_HPP */
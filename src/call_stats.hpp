@@ -0,0 +1,388 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   call_stats.hpp
+ * Author: alex
+ *
+ * Created on November 9, 2020, 7:55 PM
+ */
+
+#ifndef WILTON_PDF_CALL_STATS_HPP
+#define WILTON_PDF_CALL_STATS_HPP
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "staticlib/config.hpp"
+#include "staticlib/json.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Parts of the call, time spent outside of them (for example waiting
+ * for the document turn) is only included into the total call time
+ */
+enum class call_phase {
+    parse = 0,
+    validation = 1,
+    haru = 2,
+    io = 3
+};
+
+const size_t call_phases_count = 4;
+
+inline const char* call_phase_name(size_t phase) {
+    static const char* names[] = {"parse", "validation", "haru", "io"};
+    return names[phase];
+}
+
+/**
+ * Latency histogram with power of 2 microsecond buckets,
+ * recording is a few relaxed atomic increments, values
+ * are never reset
+ */
+class latency_histogram {
+public:
+    // bucket i counts values up to 2^i microseconds, last bucket is unbounded
+    static const size_t buckets_count = 25;
+
+    /**
+     * Histogram values at some point of time
+     */
+    struct snapshot {
+        std::array<uint64_t, buckets_count> buckets;
+        uint64_t count = 0;
+        uint64_t sum_micros = 0;
+
+        snapshot() {
+            buckets.fill(0);
+        }
+    };
+
+private:
+    std::array<std::atomic<uint64_t>, buckets_count> buckets;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_micros;
+
+public:
+    latency_histogram() {
+        for (auto& bu : buckets) {
+            bu.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        sum_micros.store(0, std::memory_order_relaxed);
+    }
+
+    latency_histogram(const latency_histogram&) = delete;
+
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    void record(uint64_t micros) {
+        size_t idx = 0;
+        while (idx < buckets_count - 1 && micros > (static_cast<uint64_t>(1) << idx)) {
+            idx += 1;
+        }
+        buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_micros.fetch_add(micros, std::memory_order_relaxed);
+    }
+
+    uint64_t get_count() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t get_sum_micros() const {
+        return sum_micros.load(std::memory_order_relaxed);
+    }
+
+    uint64_t get_bucket(size_t idx) const {
+        return buckets[idx].load(std::memory_order_relaxed);
+    }
+
+    static uint64_t bucket_bound_micros(size_t idx) {
+        return static_cast<uint64_t>(1) << idx;
+    }
+
+    snapshot take_snapshot() const {
+        auto res = snapshot();
+        for (size_t i = 0; i < buckets_count; i++) {
+            res.buckets[i] = get_bucket(i);
+        }
+        res.count = get_count();
+        res.sum_micros = get_sum_micros();
+        return res;
+    }
+
+    /**
+     * Values recorded since the specified snapshot
+     *
+     * @param since earlier snapshot of this histogram
+     * @return histogram JSON
+     */
+    sl::json::value to_json(const snapshot& since) const {
+        auto counts = std::vector<sl::json::value>();
+        for (size_t i = 0; i < buckets_count; i++) {
+            counts.emplace_back(static_cast<int64_t>(get_bucket(i) - since.buckets[i]));
+        }
+        return {
+            { "count", static_cast<int64_t>(get_count() - since.count) },
+            { "sumMicros", static_cast<int64_t>(get_sum_micros() - since.sum_micros) },
+            { "buckets", std::move(counts) }
+        };
+    }
+};
+
+/**
+ * Statistics of a single registered call, recorded values are cumulative
+ * (they are exported as Prometheus counters), reset only moves
+ * the baseline, that JSON stats are reported against
+ */
+class call_stats {
+    std::mutex baseline_mtx;
+    uint64_t errors_base = 0;
+    latency_histogram::snapshot total_base;
+    std::array<latency_histogram::snapshot, call_phases_count> phases_base;
+
+public:
+    const std::string name;
+    std::atomic<uint64_t> errors;
+    latency_histogram total;
+    std::array<latency_histogram, call_phases_count> phases;
+
+    explicit call_stats(const std::string& name) :
+    name(name),
+    errors(0) { }
+
+    call_stats(const call_stats&) = delete;
+
+    call_stats& operator=(const call_stats&) = delete;
+
+    void reset() {
+        std::lock_guard<std::mutex> guard{baseline_mtx};
+        errors_base = errors.load(std::memory_order_relaxed);
+        total_base = total.take_snapshot();
+        for (size_t i = 0; i < call_phases_count; i++) {
+            phases_base[i] = phases[i].take_snapshot();
+        }
+    }
+
+    sl::json::value to_json() {
+        std::lock_guard<std::mutex> guard{baseline_mtx};
+        auto phases_json = std::vector<sl::json::field>();
+        for (size_t i = 0; i < call_phases_count; i++) {
+            phases_json.emplace_back(call_phase_name(i), phases[i].to_json(phases_base[i]));
+        }
+        return {
+            { "errors", static_cast<int64_t>(errors.load(std::memory_order_relaxed) - errors_base) },
+            { "total", total.to_json(total_base) },
+            { "phases", std::move(phases_json) }
+        };
+    }
+};
+
+/**
+ * Module-wide event counters, never reset
+ */
+class module_counters {
+public:
+    std::atomic<uint64_t> documents_created;
+    std::atomic<uint64_t> documents_destroyed;
+    std::atomic<uint64_t> images_loaded;
+    std::atomic<uint64_t> validation_failures;
+    std::atomic<uint64_t> bytes_saved;
+
+    module_counters() :
+    documents_created(0),
+    documents_destroyed(0),
+    images_loaded(0),
+    validation_failures(0),
+    bytes_saved(0) { }
+
+    module_counters(const module_counters&) = delete;
+
+    module_counters& operator=(const module_counters&) = delete;
+};
+
+/**
+ * Statistics of all registered calls, calls are added only
+ * during module initialization
+ */
+class call_stats_registry {
+    std::vector<std::unique_ptr<call_stats>> calls;
+
+public:
+    call_stats_registry() { }
+
+    call_stats_registry(const call_stats_registry&) = delete;
+
+    call_stats_registry& operator=(const call_stats_registry&) = delete;
+
+    call_stats* add(const std::string& name) {
+        calls.emplace_back(new call_stats(name));
+        return calls.back().get();
+    }
+
+    const std::vector<std::unique_ptr<call_stats>>& list() const {
+        return calls;
+    }
+
+    void reset() {
+        for (auto& cs : calls) {
+            cs->reset();
+        }
+    }
+
+    sl::json::value to_json() const {
+        auto bounds = std::vector<sl::json::value>();
+        for (size_t i = 0; i < latency_histogram::buckets_count - 1; i++) {
+            bounds.emplace_back(static_cast<int64_t>(latency_histogram::bucket_bound_micros(i)));
+        }
+        auto calls_json = std::vector<sl::json::field>();
+        for (auto& cs : calls) {
+            calls_json.emplace_back(cs->name, cs->to_json());
+        }
+        return {
+            { "bucketBoundsMicros", std::move(bounds) },
+            { "calls", std::move(calls_json) }
+        };
+    }
+};
+
+using stats_clock = std::chrono::steady_clock;
+
+inline uint64_t micros_between(stats_clock::time_point from, stats_clock::time_point to) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+}
+
+/**
+ * Time of the call running in the current thread
+ */
+struct call_timing {
+    std::array<uint64_t, call_phases_count> phase_micros;
+    std::array<bool, call_phases_count> phase_entered;
+    int current_phase;
+    stats_clock::time_point phase_start;
+};
+
+inline call_timing*& current_call_timing() {
+    static thread_local call_timing* timing = nullptr;
+    return timing;
+}
+
+/**
+ * Measures the call running in the current thread
+ * and records it to the stats on exit
+ */
+class call_scope {
+    call_stats& stats;
+    call_timing timing;
+    // timing of the outer call on this thread, if any
+    call_timing* prev;
+    stats_clock::time_point start;
+    bool success = false;
+
+public:
+    explicit call_scope(call_stats& stats) :
+    stats(stats),
+    prev(current_call_timing()) {
+        timing.phase_micros.fill(0);
+        timing.phase_entered.fill(false);
+        timing.current_phase = -1;
+        start = stats_clock::now();
+        timing.phase_start = start;
+        current_call_timing() = std::addressof(timing);
+    }
+
+    call_scope(const call_scope&) = delete;
+
+    call_scope& operator=(const call_scope&) = delete;
+
+    ~call_scope() STATICLIB_NOEXCEPT {
+        current_call_timing() = prev;
+        stats.total.record(micros_between(start, stats_clock::now()));
+        // phases, that the call never entered, are not recorded
+        for (size_t i = 0; i < call_phases_count; i++) {
+            if (timing.phase_entered[i]) {
+                stats.phases[i].record(timing.phase_micros[i]);
+            }
+        }
+        if (!success) {
+            stats.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void mark_success() {
+        success = true;
+    }
+};
+
+/**
+ * Attributes time spent in scope to the specified phase of the current
+ * call, nested scopes pause the outer ones, does nothing outside of calls
+ */
+class phase_scope {
+    call_timing* timing;
+    int prev_phase;
+
+public:
+    explicit phase_scope(call_phase phase) :
+    timing(current_call_timing()),
+    prev_phase(-1) {
+        if (nullptr == timing) {
+            return;
+        }
+        prev_phase = timing->current_phase;
+        switch_to(static_cast<int>(phase));
+    }
+
+    phase_scope(const phase_scope&) = delete;
+
+    phase_scope& operator=(const phase_scope&) = delete;
+
+    ~phase_scope() STATICLIB_NOEXCEPT {
+        if (nullptr == timing) {
+            return;
+        }
+        switch_to(prev_phase);
+    }
+
+private:
+    void switch_to(int phase) {
+        auto now = stats_clock::now();
+        if (timing->current_phase >= 0) {
+            timing->phase_micros[static_cast<size_t>(timing->current_phase)] +=
+                    micros_between(timing->phase_start, now);
+        }
+        if (phase >= 0) {
+            timing->phase_entered[static_cast<size_t>(phase)] = true;
+        }
+        timing->current_phase = phase;
+        timing->phase_start = now;
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_CALL_STATS_HPP */
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   content_hash.hpp
+ * Author: alex
+ *
+ * Created on October 27, 2020, 8:36 PM
+ */
+
+#ifndef WILTON_PDF_CONTENT_HASH_HPP
+#define WILTON_PDF_CONTENT_HASH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+
+#include "staticlib/io.hpp"
+#include "staticlib/support.hpp"
+
+namespace wilton {
+namespace pdf {
+
+inline uint64_t rotl64(uint64_t val, int bits) {
+    return (val << bits) | (val >> (64 - bits));
+}
+
+inline uint64_t fmix64(uint64_t val) {
+    val ^= val >> 33;
+    val *= 0xff51afd7ed558ccdULL;
+    val ^= val >> 33;
+    val *= 0xc4ceb9fe1a85ec53ULL;
+    val ^= val >> 33;
+    return val;
+}
+
+/**
+ * Non-cryptographic 128-bit hash of the specified data, processes input
+ * 16 bytes at a time, is used to find candidates for identical images,
+ * matching inputs must be compared
+ *
+ * @param span input data
+ * @return hex-encoded hash (32 chars) with data length appended to it
+ */
+inline std::string content_hash(sl::io::span<const char> span) {
+    const uint64_t k1 = 0x87c37b91114253d5ULL;
+    const uint64_t k2 = 0x4cf5ad432745937fULL;
+    uint64_t len = static_cast<uint64_t>(span.size());
+    uint64_t h1 = 0x9e3779b97f4a7c15ULL ^ len;
+    uint64_t h2 = 0xc2b2ae3d27d4eb4fULL ^ len;
+    const char* data = span.data();
+    size_t blocks = span.size() / 16;
+    size_t tail = span.size() - blocks * 16;
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t w1 = 0;
+        uint64_t w2 = 0;
+        std::memcpy(std::addressof(w1), data + i * 16, 8);
+        std::memcpy(std::addressof(w2), data + i * 16 + 8, 8);
+        h1 ^= rotl64(w1 * k1, 31) * k2;
+        h1 = rotl64(h1, 27) + h2;
+        h1 = h1 * 5 + 0x52dce729;
+        h2 ^= rotl64(w2 * k2, 33) * k1;
+        h2 = rotl64(h2, 31) + h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+    uint64_t t1 = 0;
+    uint64_t t2 = 0;
+    // data may be null for empty input
+    if (tail > 0) {
+        std::memcpy(std::addressof(t1), data + blocks * 16, tail < 8 ? tail : 8);
+    }
+    if (tail > 8) {
+        std::memcpy(std::addressof(t2), data + blocks * 16 + 8, tail - 8);
+    }
+    h1 ^= rotl64(t1 * k1, 31) * k2;
+    h2 ^= rotl64(t2 * k2, 33) * k1;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    static const char* symbols = "0123456789abcdef";
+    auto res = std::string();
+    res.reserve(48);
+    for (uint64_t h : {h1, h2}) {
+        for (int shift = 60; shift >= 0; shift -= 4) {
+            res.push_back(symbols[(h >> shift) & 0xf]);
+        }
+    }
+    res.push_back('_');
+    res.append(sl::support::to_string(len));
+    return res;
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_CONTENT_HASH_HPP */
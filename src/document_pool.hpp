@@ -0,0 +1,315 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   document_pool.hpp
+ * Author: alex
+ *
+ * Created on November 2, 2020, 6:24 PM
+ */
+
+#ifndef WILTON_PDF_DOCUMENT_POOL_HPP
+#define WILTON_PDF_DOCUMENT_POOL_HPP
+
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "staticlib/config.hpp"
+#include "staticlib/json.hpp"
+
+#include "pdf_document.hpp"
+
+namespace wilton {
+namespace pdf {
+
+class document_pool;
+
+/**
+ * Single background thread, that builds documents for all registered
+ * pools, pools are served round-robin one document at a time; thread
+ * is started when the first pool needs documents
+ */
+class pool_refiller {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<std::weak_ptr<document_pool>> pools;
+    bool pending = false;
+    bool stopping = false;
+    std::thread worker;
+
+public:
+    pool_refiller() { }
+
+    pool_refiller(const pool_refiller&) = delete;
+
+    pool_refiller& operator=(const pool_refiller&) = delete;
+
+    ~pool_refiller() STATICLIB_NOEXCEPT {
+        stop();
+    }
+
+    /**
+     * Registers pool for refilling, pool is unregistered when destroyed
+     *
+     * @param pool pool to refill
+     */
+    void add(std::weak_ptr<document_pool> pool) {
+        {
+            std::lock_guard<std::mutex> guard{mtx};
+            if (stopping) {
+                return;
+            }
+            pools.emplace_back(std::move(pool));
+            pending = true;
+        }
+        cv.notify_all();
+    }
+
+    // called by non-empty pools when documents are taken or pool is reconfigured
+    void notify() {
+        {
+            std::lock_guard<std::mutex> guard{mtx};
+            if (stopping) {
+                return;
+            }
+            pending = true;
+            if (!worker.joinable()) {
+                worker = std::thread([this] {
+                    this->run();
+                });
+            }
+        }
+        cv.notify_all();
+    }
+
+    /**
+     * Stops and joins the background thread, pre-built documents remain
+     * available, must be called from module shutdown while the factory
+     * dependencies are still alive
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard{mtx};
+            stopping = true;
+        }
+        cv.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+private:
+    inline void run();
+};
+
+/**
+ * Pool of pre-built documents, documents taken from the pool are
+ * replaced with new ones by the refiller thread. Pool is empty
+ * until it is configured with a non-zero size.
+ */
+class document_pool {
+    std::shared_ptr<pool_refiller> refiller;
+    std::mutex mtx;
+    std::deque<std::unique_ptr<pdf_context>> available;
+    std::function<std::unique_ptr<pdf_context>()> factory;
+    size_t max_size = 0;
+    // changes on reconfiguration, documents built with older
+    // factories are discarded
+    uint64_t generation = 0;
+    std::string last_error;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+public:
+    explicit document_pool(std::shared_ptr<pool_refiller> refiller) :
+    refiller(std::move(refiller)) { }
+
+    document_pool(const document_pool&) = delete;
+
+    document_pool& operator=(const document_pool&) = delete;
+
+    /**
+     * Replaces pooled documents with the ones built by the specified factory
+     *
+     * @param size number of documents to keep ready, zero disables the pool
+     * @param fac document factory, called from the refiller thread
+     */
+    void configure(size_t size, std::function<std::unique_ptr<pdf_context>()> fac) {
+        auto discarded = std::deque<std::unique_ptr<pdf_context>>();
+        {
+            std::lock_guard<std::mutex> guard{mtx};
+            max_size = size;
+            factory = std::move(fac);
+            generation += 1;
+            last_error.clear();
+            discarded.swap(available);
+        }
+        if (size > 0) {
+            refiller->notify();
+        }
+    }
+
+    /**
+     * Adds document, that was built by the current factory, to the pool
+     *
+     * @param ctx document
+     * @return empty pointer if document was added, passed document
+     *         if the pool is full
+     */
+    std::unique_ptr<pdf_context> offer(std::unique_ptr<pdf_context> ctx) {
+        std::lock_guard<std::mutex> guard{mtx};
+        if (available.size() < max_size) {
+            available.push_back(std::move(ctx));
+        }
+        return ctx;
+    }
+
+    /**
+     * Takes pre-built document from the pool
+     *
+     * @return document or empty pointer if the pool is exhausted
+     */
+    std::unique_ptr<pdf_context> take() {
+        auto res = std::unique_ptr<pdf_context>();
+        {
+            std::lock_guard<std::mutex> guard{mtx};
+            if (0 == max_size) {
+                return res;
+            }
+            if (available.empty()) {
+                misses += 1;
+                return res;
+            }
+            hits += 1;
+            res = std::move(available.front());
+            available.pop_front();
+        }
+        refiller->notify();
+        return res;
+    }
+
+    sl::json::value stats() {
+        std::lock_guard<std::mutex> guard{mtx};
+        return {
+            { "size", static_cast<int64_t>(max_size) },
+            { "available", static_cast<int64_t>(available.size()) },
+            { "hits", static_cast<int64_t>(hits) },
+            { "misses", static_cast<int64_t>(misses) },
+            { "lastError", last_error }
+        };
+    }
+
+    /**
+     * Builds one document if the pool is not full, is called
+     * from the refiller thread
+     *
+     * @return whether more documents are needed
+     */
+    bool refill_one() {
+        auto fac = std::function<std::unique_ptr<pdf_context>()>();
+        uint64_t gen = 0;
+        {
+            std::lock_guard<std::mutex> guard{mtx};
+            if (!needs_refill()) {
+                return false;
+            }
+            fac = factory;
+            gen = generation;
+        }
+        auto ctx = std::unique_ptr<pdf_context>();
+        auto err = std::string();
+        try {
+            ctx = fac();
+        } catch (const std::exception& e) {
+            err = e.what();
+        }
+        {
+            std::lock_guard<std::mutex> guard{mtx};
+            if (gen == generation) {
+                if (err.empty()) {
+                    available.push_back(std::move(ctx));
+                } else {
+                    // stop refilling until reconfigured
+                    last_error = err;
+                }
+            }
+            if (!needs_refill()) {
+                return false;
+            }
+        }
+        // document of older generation is freed outside of the lock
+        return true;
+    }
+
+private:
+    bool needs_refill() {
+        return available.size() < max_size && last_error.empty();
+    }
+};
+
+inline void pool_refiller::run() {
+    std::unique_lock<std::mutex> guard{mtx};
+    for (;;) {
+        cv.wait(guard, [this] {
+            return stopping || pending;
+        });
+        if (stopping) {
+            return;
+        }
+        pending = false;
+        auto list = pools;
+        guard.unlock();
+        // one document per pool per pass
+        bool more = true;
+        while (more) {
+            more = false;
+            for (auto& weak : list) {
+                {
+                    std::lock_guard<std::mutex> stop_guard{mtx};
+                    if (stopping) {
+                        return;
+                    }
+                }
+                auto pool = weak.lock();
+                if (nullptr != pool.get() && pool->refill_one()) {
+                    more = true;
+                }
+            }
+        }
+        guard.lock();
+        // forget destroyed pools
+        auto live = std::vector<std::weak_ptr<document_pool>>();
+        for (auto& weak : pools) {
+            if (!weak.expired()) {
+                live.emplace_back(std::move(weak));
+            }
+        }
+        pools.swap(live);
+    }
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_DOCUMENT_POOL_HPP */
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   field_schema.hpp
+ * Author: alex
+ *
+ * Created on November 19, 2020, 5:21 PM
+ */
+
+#ifndef WILTON_PDF_FIELD_SCHEMA_HPP
+#define WILTON_PDF_FIELD_SCHEMA_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "staticlib/config.hpp"
+#include "staticlib/json.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Input field of a call
+ */
+struct field_spec {
+    const char* name;
+    bool required;
+};
+
+/**
+ * Fields of a call input, is built at runtime once per call (on first use)
+ * from the list of fields, field index in the list is used as a field ID.
+ * Lookup hashes name length, first and last chars into a small table and
+ * compares the name only once for known fields.
+ */
+class field_schema {
+    static const size_t table_size = 64;
+    // bit per field in 32-bit masks, table is never full
+    static const size_t max_fields = 32 < table_size ? 32 : table_size;
+
+    std::vector<std::string> names;
+    // field index + 1, zero for empty slots
+    std::array<uint8_t, table_size> table;
+    uint32_t required_mask = 0;
+
+public:
+    field_schema(std::initializer_list<field_spec> fields) {
+        if (fields.size() > max_fields) throw support::exception(TRACEMSG(
+                "Too many fields in schema, count: [" + sl::support::to_string(fields.size()) + "]," +
+                " max count: [" + sl::support::to_string(static_cast<uint64_t>(max_fields)) + "]"));
+        table.fill(0);
+        for (auto& fs : fields) {
+            auto idx = names.size();
+            names.emplace_back(fs.name);
+            if (fs.required) {
+                required_mask |= (1u << idx);
+            }
+            size_t slot = slot_for(names.back().data(), names.back().length());
+            while (0 != table[slot]) {
+                slot = (slot + 1) % table_size;
+            }
+            table[slot] = static_cast<uint8_t>(idx + 1);
+        }
+    }
+
+    field_schema(const field_schema&) = delete;
+
+    field_schema& operator=(const field_schema&) = delete;
+
+    /**
+     * Finds field ID by its name
+     *
+     * @param name field name
+     * @return field ID or -1 for unknown field
+     */
+    int find(const std::string& name) const {
+        return find(name.data(), name.length());
+    }
+
+    /**
+     * Finds field ID by its name
+     *
+     * @param name field name, not required to be null-terminated
+     * @param len field name length
+     * @return field ID or -1 for unknown field
+     */
+    int find(const char* name, size_t len) const {
+        if (0 == len) {
+            return -1;
+        }
+        size_t slot = slot_for(name, len);
+        for (;;) {
+            uint8_t en = table[slot];
+            if (0 == en) {
+                return -1;
+            }
+            auto& candidate = names[en - 1];
+            if (candidate.length() == len &&
+                    0 == std::memcmp(candidate.data(), name, len)) {
+                return en - 1;
+            }
+            slot = (slot + 1) % table_size;
+        }
+    }
+
+    /**
+     * Passes every input field to the specified binder, fails on
+     * unknown fields and on missing required fields
+     *
+     * @param json call input object
+     * @param binder functor accepting field ID and the field itself
+     * @param required_first ID of the field, that is required in addition to
+     *        the required fields of the schema and is checked before them,
+     *        -1 for none
+     */
+    template<typename Binder>
+    void bind(const sl::json::value& json, Binder binder, int required_first = -1) const {
+        uint32_t seen = 0;
+        for (const sl::json::field& fi : json.as_object()) {
+            int id = find(fi.name());
+            if (-1 == id) throw support::exception(TRACEMSG("Unknown data field: [" + fi.name() + "]"));
+            binder(id, fi);
+            seen |= (1u << id);
+        }
+        check_required(seen, required_first);
+    }
+
+    /**
+     * Checks that all required fields are present
+     *
+     * @param seen mask of fields present in input, bit index is a field ID
+     * @return true if all required fields are present
+     */
+    bool has_required(uint32_t seen) const {
+        return 0 == (required_mask & ~seen);
+    }
+
+    /**
+     * Checks that all required fields are present
+     *
+     * @param seen mask of fields present in input, bit index is a field ID
+     * @param required_first ID of the field, that is required in addition to
+     *        the required fields of the schema and is checked before them,
+     *        -1 for none
+     */
+    void check_required(uint32_t seen, int required_first = -1) const {
+        if (-1 != required_first && 0 == (seen & (1u << required_first))) throw support::exception(TRACEMSG(
+                "Required parameter '" + name(required_first) + "' not specified"));
+        uint32_t missing = required_mask & ~seen;
+        if (0 == missing) {
+            return;
+        }
+        for (size_t i = 0; i < names.size(); i++) {
+            if (0 != (missing & (1u << i))) throw support::exception(TRACEMSG(
+                    "Required parameter '" + names[i] + "' not specified"));
+        }
+    }
+
+    const std::string& name(int id) const {
+        return names.at(static_cast<size_t>(id));
+    }
+
+private:
+    static size_t slot_for(const char* name, size_t len) {
+        auto first = static_cast<unsigned char>(name[0]);
+        auto last = static_cast<unsigned char>(name[len - 1]);
+        return (len * 31 + first * 7 + last) % table_size;
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_FIELD_SCHEMA_HPP */
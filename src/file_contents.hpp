@@ -0,0 +1,158 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   file_contents.hpp
+ * Author: alex
+ *
+ * Created on November 26, 2020, 4:55 PM
+ */
+
+#ifndef WILTON_PDF_FILE_CONTENTS_HPP
+#define WILTON_PDF_FILE_CONTENTS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "staticlib/config.hpp"
+
+#ifndef STATICLIB_WINDOWS
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // !STATICLIB_WINDOWS
+
+#include "staticlib/io.hpp"
+#include "staticlib/support.hpp"
+#include "staticlib/tinydir.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "file_fingerprint.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Contents of a file read until EOF into a buffer sized from the file
+ * size, fingerprint is taken from the same descriptor the file is read from. Contents do
+ * not depend on the file after reading, so they can be kept and shared
+ * between calls while the file is modified.
+ */
+class file_contents {
+    std::vector<char> buffer;
+    std::string fp;
+
+public:
+    explicit file_contents(const std::string& path) {
+#ifndef STATICLIB_WINDOWS
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (-1 == fd) throw support::exception(TRACEMSG(
+                "Error opening file, path: [" + path + "]"));
+        auto deferred = sl::support::defer([fd]() STATICLIB_NOEXCEPT {
+            ::close(fd);
+        });
+        struct stat st;
+        if (0 != ::fstat(fd, std::addressof(st))) throw support::exception(TRACEMSG(
+                "Error accessing file, path: [" + path + "]"));
+        fp = file_fingerprint_from_stat(path, st);
+        // pipes, devices and procfs files report no size
+        size_t size = S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) : 0;
+        read_fd(fd, size, path);
+#else // STATICLIB_WINDOWS
+        uint64_t size = 0;
+        // file may be replaced between this call and reading
+        fp = file_fingerprint(path, std::addressof(size));
+        buffer.resize(static_cast<size_t>(size));
+        auto src = sl::tinydir::file_source(path);
+        sl::io::read_all(src, {buffer.data(), buffer.size()});
+#endif // !STATICLIB_WINDOWS
+    }
+
+    file_contents(const file_contents&) = delete;
+
+    file_contents& operator=(const file_contents&) = delete;
+
+    sl::io::span<const char> data() const {
+        return {buffer.data(), buffer.size()};
+    }
+
+    size_t size() const {
+        return buffer.size();
+    }
+
+    sl::io::span<char> mutable_data() {
+        return {buffer.data(), buffer.size()};
+    }
+
+    /**
+     * Fingerprint of the file taken from the descriptor it was read from,
+     * file modified in place while being read is not detected
+     *
+     * @return file fingerprint
+     */
+    const std::string& fingerprint() const {
+        return fp;
+    }
+
+private:
+#ifndef STATICLIB_WINDOWS
+    // reads the expected size directly into the buffer, then reads until EOF
+    void read_fd(int fd, size_t size, const std::string& path) {
+        buffer.resize(size);
+        size_t total = read_full(fd, buffer.data(), size, path);
+        if (total < size) {
+            // file was truncated after 'fstat'
+            buffer.resize(total);
+            return;
+        }
+        // file grew after 'fstat' or its size is not known
+        char chunk[4096];
+        for (;;) {
+            size_t rd = read_full(fd, chunk, sizeof(chunk), path);
+            buffer.insert(buffer.end(), chunk, chunk + rd);
+            if (rd < sizeof(chunk)) {
+                break;
+            }
+        }
+    }
+
+    // fills the destination until it is full or EOF is reached, loop handles short reads
+    static size_t read_full(int fd, char* dest, size_t size, const std::string& path) {
+        size_t total = 0;
+        while (total < size) {
+            auto rd = ::read(fd, dest + total, size - total);
+            if (-1 == rd && EINTR == errno) {
+                continue;
+            }
+            if (-1 == rd) throw support::exception(TRACEMSG(
+                    "Error reading file, path: [" + path + "]"));
+            if (0 == rd) {
+                break;
+            }
+            total += static_cast<size_t>(rd);
+        }
+        return total;
+    }
+#endif // !STATICLIB_WINDOWS
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_FILE_CONTENTS_HPP */
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   file_fingerprint.hpp
+ * Author: alex
+ *
+ * Created on October 31, 2020, 4:25 PM
+ */
+
+#ifndef WILTON_PDF_FILE_FINGERPRINT_HPP
+#define WILTON_PDF_FILE_FINGERPRINT_HPP
+
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "staticlib/config.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Builds the fingerprint from the attributes of a file, modification time
+ * has nanosecond precision where it is available
+ *
+ * @param path file path
+ * @param st file attributes, either from 'stat' on the path or
+ *        from 'fstat' on the descriptor the file is read from
+ * @return string with path, modification time and size of the file
+ */
+template<typename Stat>
+std::string file_fingerprint_from_stat(const std::string& path, const Stat& st) {
+#if defined(STATICLIB_LINUX)
+    auto mtime_nsec = static_cast<int64_t>(st.st_mtim.tv_nsec);
+#elif defined(STATICLIB_MAC)
+    auto mtime_nsec = static_cast<int64_t>(st.st_mtimespec.tv_nsec);
+#else
+    // seconds only
+    int64_t mtime_nsec = 0;
+#endif
+    return path + "|" + sl::support::to_string(static_cast<int64_t>(st.st_mtime)) +
+            "." + sl::support::to_string(mtime_nsec) +
+            "|" + sl::support::to_string(static_cast<int64_t>(st.st_size));
+}
+
+/**
+ * Identifies the contents of a file without reading it,
+ * changes when the file is modified. File is accessed by path,
+ * it may be replaced before it is opened for reading, callers
+ * that read the file themselves should use 'file_contents::fingerprint()'.
+ *
+ * @param path file path
+ * @param size_out optional output parameter for file size
+ * @return string with path, modification time and size of the file
+ */
+inline std::string file_fingerprint(const std::string& path, uint64_t* size_out = nullptr) {
+#ifdef STATICLIB_WINDOWS
+    struct _stat64 st;
+    auto err = _stat64(path.c_str(), std::addressof(st));
+#else // !STATICLIB_WINDOWS
+    struct stat st;
+    auto err = ::stat(path.c_str(), std::addressof(st));
+#endif // STATICLIB_WINDOWS
+    if (0 != err) throw support::exception(TRACEMSG(
+            "Error accessing file, path: [" + path + "]"));
+    if (nullptr != size_out) {
+        *size_out = static_cast<uint64_t>(st.st_size);
+    }
+    return file_fingerprint_from_stat(path, st);
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_FILE_FINGERPRINT_HPP */
@@ -0,0 +1,341 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   flat_json_reader.hpp
+ * Author: alex
+ *
+ * Created on November 20, 2020, 4:12 PM
+ */
+
+#ifndef WILTON_PDF_FLAT_JSON_READER_HPP
+#define WILTON_PDF_FLAT_JSON_READER_HPP
+
+#include <cerrno>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "staticlib/io.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Reads fields of a JSON object directly from the input without building
+ * a JSON tree. Supports only the inputs of primitive calls: objects with
+ * number, string and nested object values. Field names with escapes,
+ * '\u' escapes in strings and literal values are not supported.
+ *
+ * Reader does not report errors, all read methods return 'false' on
+ * unsupported or malformed input, such input is expected to be parsed
+ * again by the full JSON parser to get a proper error message.
+ */
+class flat_json_reader {
+    const char* pos;
+    const char* end;
+    size_t depth = 0;
+    bool first_field = false;
+    bool failed = false;
+
+public:
+    explicit flat_json_reader(sl::io::span<const char> data) :
+    pos(data.data()),
+    end(data.data() + data.size()) { }
+
+    flat_json_reader(const flat_json_reader&) = delete;
+
+    flat_json_reader& operator=(const flat_json_reader&) = delete;
+
+    /**
+     * Enters an object, is used for the top-level input
+     * and for nested object values
+     *
+     * @return false if object is not found in input
+     */
+    bool begin_object() {
+        skip_ws();
+        if (pos == end || '{' != *pos) {
+            return fail();
+        }
+        pos += 1;
+        depth += 1;
+        first_field = true;
+        return true;
+    }
+
+    /**
+     * Moves to the next field of the current object
+     *
+     * @param name_out field name, points into input
+     * @return false on object end or on malformed input
+     */
+    bool next_field(sl::io::span<const char>& name_out) {
+        if (failed || 0 == depth) {
+            return false;
+        }
+        skip_ws();
+        if (pos == end) {
+            return fail();
+        }
+        if ('}' == *pos) {
+            pos += 1;
+            depth -= 1;
+            first_field = false;
+            return false;
+        }
+        if (!first_field) {
+            if (',' != *pos) {
+                return fail();
+            }
+            pos += 1;
+            skip_ws();
+        }
+        first_field = false;
+        if (pos == end || '"' != *pos) {
+            return fail();
+        }
+        pos += 1;
+        const char* name = pos;
+        while (pos < end && '"' != *pos) {
+            if ('\\' == *pos || static_cast<unsigned char>(*pos) < 0x20) {
+                return fail();
+            }
+            pos += 1;
+        }
+        if (pos == end) {
+            return fail();
+        }
+        name_out = sl::io::span<const char>(name, static_cast<size_t>(pos - name));
+        pos += 1;
+        skip_ws();
+        if (pos == end || ':' != *pos) {
+            return fail();
+        }
+        pos += 1;
+        skip_ws();
+        return true;
+    }
+
+    /**
+     * Checks that the top-level object was read completely
+     * and that nothing except whitespace follows it
+     *
+     * @return true if the whole input was read successfully
+     */
+    bool finished() {
+        if (failed || 0 != depth) {
+            return false;
+        }
+        skip_ws();
+        return pos == end;
+    }
+
+    bool read_int64(int64_t& out) {
+        double unused = 0;
+        bool is_integer = false;
+        return read_number(out, unused, is_integer) && (is_integer || fail());
+    }
+
+    bool read_uint16(int32_t& out) {
+        int64_t val = 0;
+        if (!read_int64(val) || val < 0 || val > UINT16_MAX) {
+            return fail();
+        }
+        out = static_cast<int32_t>(val);
+        return true;
+    }
+
+    bool read_int32(int32_t& out) {
+        int64_t val = 0;
+        if (!read_int64(val) || val < INT32_MIN || val > INT32_MAX) {
+            return fail();
+        }
+        out = static_cast<int32_t>(val);
+        return true;
+    }
+
+    /**
+     * Reads integer or real number as float
+     */
+    bool read_float(float& out) {
+        int64_t ival = 0;
+        double dval = 0;
+        bool is_integer = false;
+        if (!read_number(ival, dval, is_integer)) {
+            return false;
+        }
+        if (is_integer) {
+            out = static_cast<float>(ival);
+            return true;
+        }
+        if (dval > FLT_MAX || dval < -FLT_MAX) {
+            return fail();
+        }
+        out = static_cast<float>(dval);
+        return true;
+    }
+
+    /**
+     * Reads non-empty string value, 'out' is reused between calls
+     * to not allocate for every string
+     */
+    bool read_string_nonempty(std::string& out) {
+        out.clear();
+        if (pos == end || '"' != *pos) {
+            return fail();
+        }
+        pos += 1;
+        const char* run = pos;
+        while (pos < end) {
+            auto ch = static_cast<unsigned char>(*pos);
+            if ('"' == ch) {
+                out.append(run, pos);
+                pos += 1;
+                return !out.empty() || fail();
+            } else if ('\\' == ch) {
+                out.append(run, pos);
+                if (!read_escape(out)) {
+                    return fail();
+                }
+                run = pos;
+            } else if (ch < 0x20) {
+                return fail();
+            } else if (ch < 0x80) {
+                pos += 1;
+            } else if (!skip_utf8()) {
+                return fail();
+            }
+        }
+        return fail();
+    }
+
+private:
+    bool fail() {
+        failed = true;
+        return false;
+    }
+
+    void skip_ws() {
+        while (pos < end && (' ' == *pos || '\n' == *pos || '\r' == *pos || '\t' == *pos)) {
+            pos += 1;
+        }
+    }
+
+    static bool is_digit(char ch) {
+        return ch >= '0' && ch <= '9';
+    }
+
+    bool read_number(int64_t& ival, double& dval, bool& is_integer) {
+        // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+        const char* start = pos;
+        const char* cur = pos;
+        if (cur < end && '-' == *cur) cur += 1;
+        if (cur == end || !is_digit(*cur)) return fail();
+        if ('0' == *cur) {
+            cur += 1;
+        } else {
+            while (cur < end && is_digit(*cur)) cur += 1;
+        }
+        is_integer = true;
+        if (cur < end && '.' == *cur) {
+            is_integer = false;
+            cur += 1;
+            if (cur == end || !is_digit(*cur)) return fail();
+            while (cur < end && is_digit(*cur)) cur += 1;
+        }
+        if (cur < end && ('e' == *cur || 'E' == *cur)) {
+            is_integer = false;
+            cur += 1;
+            if (cur < end && ('+' == *cur || '-' == *cur)) cur += 1;
+            if (cur == end || !is_digit(*cur)) return fail();
+            while (cur < end && is_digit(*cur)) cur += 1;
+        }
+        // input is not null-terminated
+        char buf[32];
+        size_t len = static_cast<size_t>(cur - start);
+        if (len >= sizeof(buf)) return fail();
+        std::memcpy(buf, start, len);
+        buf[len] = '\0';
+        char* parsed_end = nullptr;
+        errno = 0;
+        if (is_integer) {
+            ival = std::strtoll(buf, std::addressof(parsed_end), 10);
+        } else {
+            dval = std::strtod(buf, std::addressof(parsed_end));
+        }
+        if (0 != errno || buf + len != parsed_end) return fail();
+        pos = cur;
+        return true;
+    }
+
+    bool read_escape(std::string& out) {
+        // pos points to backslash
+        pos += 1;
+        if (pos == end) return false;
+        char ch = *pos;
+        switch (ch) {
+        case '"': case '\\': case '/': out.push_back(ch); break;
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        default: return false;
+        }
+        pos += 1;
+        return true;
+    }
+
+    // validates a single multi-byte UTF-8 sequence
+    bool skip_utf8() {
+        auto lead = static_cast<unsigned char>(*pos);
+        size_t len = 0;
+        uint32_t cp = 0;
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            len = 2;
+            cp = lead & 0x1f;
+        } else if (lead >= 0xe0 && lead <= 0xef) {
+            len = 3;
+            cp = lead & 0x0f;
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            len = 4;
+            cp = lead & 0x07;
+        } else {
+            return false;
+        }
+        if (static_cast<size_t>(end - pos) < len) return false;
+        for (size_t i = 1; i < len; i++) {
+            auto cont = static_cast<unsigned char>(pos[i]);
+            if (0x80 != (cont & 0xc0)) return false;
+            cp = (cp << 6) | (cont & 0x3f);
+        }
+        // overlong forms, surrogates and out of range code points
+        if ((3 == len && cp < 0x800) || (4 == len && (cp < 0x10000 || cp > 0x10ffff)) ||
+                (cp >= 0xd800 && cp <= 0xdfff)) {
+            return false;
+        }
+        pos += len;
+        return true;
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_FLAT_JSON_READER_HPP */
@@ -0,0 +1,416 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   flat_parsers.hpp
+ * Author: alex
+ *
+ * Created on December 15, 2020, 2:37 PM
+ */
+
+#ifndef WILTON_PDF_FLAT_PARSERS_HPP
+#define WILTON_PDF_FLAT_PARSERS_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "staticlib/io.hpp"
+#include "staticlib/json.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "field_schema.hpp"
+#include "flat_json_reader.hpp"
+
+namespace wilton {
+namespace pdf {
+
+// arguments of primitive calls, that are parsed both with flat reader
+// and from JSON, own their strings, as flat reader reads them
+// from the input without building JSON tree
+
+inline float ungarble_float(const sl::json::value& val, const std::string& context) {
+    float res = [&val, &context]() -> float {
+        switch(val.json_type()) {
+        case sl::json::type::real: return val.as_float_or_throw(context);
+        case sl::json::type::integer: return static_cast<float>(val.as_int64_or_throw(context));
+        default: throw support::exception(TRACEMSG(
+                "Invalid RGB color element specified," +
+                " type: [" + sl::json::stringify_json_type(val.json_type()) + "]," +
+                " value: [" + val.dumps() + "]"));
+        }
+    } ();
+    return res;
+}
+
+class rgb_color {
+public:
+    float r = 0;
+    float g = 0;
+    float b = 0;
+
+    rgb_color() { }
+
+    rgb_color(const sl::json::value& val) :
+    r(check01(ungarble_float(val["r"], "color.r"))),
+    g(check01(ungarble_float(val["g"], "color.g"))),
+    b(check01(ungarble_float(val["b"], "color.b"))) { }
+
+private:
+    static float check01(float val) {
+        if (val < static_cast<float>(0) || val > static_cast<float>(1)) {
+            throw support::exception(TRACEMSG(
+                    "Invalid RGB color element specified," +
+                    " value: [" + sl::support::to_string(val) + "]"));
+        }
+        return val;
+    }
+};
+
+inline bool read_flat_color(flat_json_reader& reader, rgb_color& color) {
+    if (!reader.begin_object()) {
+        return false;
+    }
+    uint32_t seen = 0;
+    auto name = sl::io::span<const char>(nullptr, 0);
+    while (reader.next_field(name)) {
+        float val = 0;
+        if (1 != name.size() || !reader.read_float(val) || val < 0 || val > 1) {
+            return false;
+        }
+        uint32_t bit = 0;
+        switch (name.data()[0]) {
+        case 'r': color.r = val; bit = 1; break;
+        case 'g': color.g = val; bit = 2; break;
+        case 'b': color.b = val; bit = 4; break;
+        default: return false;
+        }
+        // duplicate fields are left to the full parser
+        if (0 != (seen & bit)) {
+            return false;
+        }
+        seen |= bit;
+    }
+    return 7 == seen;
+}
+
+struct write_text_args {
+    int64_t handle = -1;
+    std::string font_name;
+    float font_size = -1;
+    std::string text;
+    int32_t x = -1;
+    int32_t y = -1;
+    rgb_color color;
+};
+
+struct write_text_inside_rectangle_args {
+    int64_t handle = -1;
+    std::string font_name;
+    float font_size = -1;
+    std::string text;
+    int32_t left = -1;
+    int32_t top = -1;
+    int32_t right = -1;
+    int32_t bottom = -1;
+    std::string align;
+    rgb_color color;
+};
+
+struct draw_line_args {
+    int64_t handle = -1;
+    int32_t beginX = -1;
+    int32_t beginY = -1;
+    int32_t endX = -1;
+    int32_t endY = -1;
+    float lineWidth = 1;
+    rgb_color color;
+};
+
+struct draw_rectangle_args {
+    int64_t handle = -1;
+    int32_t x = -1;
+    int32_t y = -1;
+    int32_t width = -1;
+    int32_t height = -1;
+    float lineWidth = 1;
+    rgb_color color;
+};
+
+enum class write_text_field { handle, font_name, font_size, x, y, text, color };
+
+inline const field_schema& write_text_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "fontName", true },
+        { "fontSize", true },
+        { "x", true },
+        { "y", true },
+        { "text", true },
+        { "color", false }
+    };
+    return schema;
+}
+
+inline write_text_args parse_write_text(const sl::json::value& json, bool handle_required) {
+    auto args = write_text_args();
+    write_text_schema().bind(json, [&args](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (static_cast<write_text_field>(id)) {
+        case write_text_field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case write_text_field::font_name: args.font_name = fi.as_string_nonempty_or_throw(name); break;
+        case write_text_field::font_size: args.font_size = ungarble_float(fi.val(), name); break;
+        case write_text_field::x: args.x = fi.as_uint16_or_throw(name); break;
+        case write_text_field::y: args.y = fi.as_uint16_or_throw(name); break;
+        case write_text_field::text: args.text = fi.as_string_nonempty_or_throw(name); break;
+        case write_text_field::color: args.color = rgb_color(fi.val()); break;
+        }
+    }, handle_required ? static_cast<int>(write_text_field::handle) : -1);
+    if (args.font_size < 0) throw support::exception(TRACEMSG(
+            "Required parameter 'fontSize' not specified"));
+    return args;
+}
+
+inline bool parse_write_text_flat(sl::io::span<const char> data, write_text_args& args) {
+    auto& schema = write_text_schema();
+    flat_json_reader reader(data);
+    if (!reader.begin_object()) {
+        return false;
+    }
+    uint32_t seen = 0;
+    auto name = sl::io::span<const char>(nullptr, 0);
+    while (reader.next_field(name)) {
+        int id = schema.find(name.data(), name.size());
+        bool ok = false;
+        switch (static_cast<write_text_field>(id)) {
+        case write_text_field::handle: ok = reader.read_int64(args.handle); break;
+        case write_text_field::font_name: ok = reader.read_string_nonempty(args.font_name); break;
+        case write_text_field::font_size: ok = reader.read_float(args.font_size); break;
+        case write_text_field::x: ok = reader.read_uint16(args.x); break;
+        case write_text_field::y: ok = reader.read_uint16(args.y); break;
+        case write_text_field::text: ok = reader.read_string_nonempty(args.text); break;
+        case write_text_field::color: ok = read_flat_color(reader, args.color); break;
+        }
+        // duplicate fields are left to the full parser
+        if (!ok || 0 != (seen & (1u << id))) {
+            return false;
+        }
+        seen |= (1u << id);
+    }
+    return reader.finished() && schema.has_required(seen) && args.font_size >= 0;
+}
+
+enum class write_text_inside_rectangle_field {
+    handle, font_name, font_size, left, top, right, bottom, text, align, color
+};
+
+inline const field_schema& write_text_inside_rectangle_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "fontName", true },
+        { "fontSize", true },
+        { "left", true },
+        { "top", true },
+        { "right", true },
+        { "bottom", true },
+        { "text", true },
+        { "align", true },
+        { "color", false }
+    };
+    return schema;
+}
+
+inline write_text_inside_rectangle_args parse_write_text_inside_rectangle(const sl::json::value& json,
+        bool handle_required) {
+    using field = write_text_inside_rectangle_field;
+    auto args = write_text_inside_rectangle_args();
+    write_text_inside_rectangle_schema().bind(json, [&args](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (static_cast<field>(id)) {
+        case field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case field::font_name: args.font_name = fi.as_string_nonempty_or_throw(name); break;
+        case field::font_size: args.font_size = ungarble_float(fi.val(), name); break;
+        case field::left: args.left = fi.as_uint16_or_throw(name); break;
+        case field::top: args.top = fi.as_uint16_or_throw(name); break;
+        case field::right: args.right = fi.as_uint16_or_throw(name); break;
+        case field::bottom: args.bottom = fi.as_uint16_or_throw(name); break;
+        case field::text: args.text = fi.as_string_nonempty_or_throw(name); break;
+        case field::align: args.align = fi.as_string_nonempty_or_throw(name); break;
+        case field::color: args.color = rgb_color(fi.val()); break;
+        }
+    }, handle_required ? static_cast<int>(field::handle) : -1);
+    if (args.font_size < 0) throw support::exception(TRACEMSG(
+            "Required parameter 'fontSize' not specified"));
+    return args;
+}
+
+inline bool parse_write_text_inside_rectangle_flat(sl::io::span<const char> data, write_text_inside_rectangle_args& args) {
+    using field = write_text_inside_rectangle_field;
+    auto& schema = write_text_inside_rectangle_schema();
+    flat_json_reader reader(data);
+    if (!reader.begin_object()) {
+        return false;
+    }
+    uint32_t seen = 0;
+    auto name = sl::io::span<const char>(nullptr, 0);
+    while (reader.next_field(name)) {
+        int id = schema.find(name.data(), name.size());
+        bool ok = false;
+        switch (static_cast<field>(id)) {
+        case field::handle: ok = reader.read_int64(args.handle); break;
+        case field::font_name: ok = reader.read_string_nonempty(args.font_name); break;
+        case field::font_size: ok = reader.read_float(args.font_size); break;
+        case field::left: ok = reader.read_uint16(args.left); break;
+        case field::top: ok = reader.read_uint16(args.top); break;
+        case field::right: ok = reader.read_uint16(args.right); break;
+        case field::bottom: ok = reader.read_uint16(args.bottom); break;
+        case field::text: ok = reader.read_string_nonempty(args.text); break;
+        case field::align: ok = reader.read_string_nonempty(args.align); break;
+        case field::color: ok = read_flat_color(reader, args.color); break;
+        }
+        if (!ok || 0 != (seen & (1u << id))) {
+            return false;
+        }
+        seen |= (1u << id);
+    }
+    return reader.finished() && schema.has_required(seen) && args.font_size >= 0;
+}
+
+enum class draw_line_field { handle, begin_x, begin_y, end_x, end_y, color, line_width };
+
+inline const field_schema& draw_line_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "beginX", true },
+        { "beginY", true },
+        { "endX", true },
+        { "endY", true },
+        { "color", false },
+        { "lineWidth", false }
+    };
+    return schema;
+}
+
+inline draw_line_args parse_draw_line(const sl::json::value& json, bool handle_required) {
+    auto args = draw_line_args();
+    draw_line_schema().bind(json, [&args](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (static_cast<draw_line_field>(id)) {
+        case draw_line_field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case draw_line_field::begin_x: args.beginX = fi.as_uint16_or_throw(name); break;
+        case draw_line_field::begin_y: args.beginY = fi.as_uint16_or_throw(name); break;
+        case draw_line_field::end_x: args.endX = fi.as_uint16_or_throw(name); break;
+        case draw_line_field::end_y: args.endY = fi.as_uint16_or_throw(name); break;
+        case draw_line_field::color: args.color = rgb_color(fi.val()); break;
+        case draw_line_field::line_width: args.lineWidth = ungarble_float(fi.val(), name); break;
+        }
+    }, handle_required ? static_cast<int>(draw_line_field::handle) : -1);
+    return args;
+}
+
+inline bool parse_draw_line_flat(sl::io::span<const char> data, draw_line_args& args) {
+    auto& schema = draw_line_schema();
+    flat_json_reader reader(data);
+    if (!reader.begin_object()) {
+        return false;
+    }
+    uint32_t seen = 0;
+    auto name = sl::io::span<const char>(nullptr, 0);
+    while (reader.next_field(name)) {
+        int id = schema.find(name.data(), name.size());
+        bool ok = false;
+        switch (static_cast<draw_line_field>(id)) {
+        case draw_line_field::handle: ok = reader.read_int64(args.handle); break;
+        case draw_line_field::begin_x: ok = reader.read_uint16(args.beginX); break;
+        case draw_line_field::begin_y: ok = reader.read_uint16(args.beginY); break;
+        case draw_line_field::end_x: ok = reader.read_uint16(args.endX); break;
+        case draw_line_field::end_y: ok = reader.read_uint16(args.endY); break;
+        case draw_line_field::color: ok = read_flat_color(reader, args.color); break;
+        case draw_line_field::line_width: ok = reader.read_float(args.lineWidth); break;
+        }
+        if (!ok || 0 != (seen & (1u << id))) {
+            return false;
+        }
+        seen |= (1u << id);
+    }
+    return reader.finished() && schema.has_required(seen);
+}
+
+enum class draw_rectangle_field { handle, x, y, width, height, color, line_width };
+
+inline const field_schema& draw_rectangle_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "x", true },
+        { "y", true },
+        { "width", true },
+        { "height", true },
+        { "color", false },
+        { "lineWidth", false }
+    };
+    return schema;
+}
+
+inline draw_rectangle_args parse_draw_rectangle(const sl::json::value& json, bool handle_required) {
+    auto args = draw_rectangle_args();
+    draw_rectangle_schema().bind(json, [&args](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (static_cast<draw_rectangle_field>(id)) {
+        case draw_rectangle_field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case draw_rectangle_field::x: args.x = fi.as_uint16_or_throw(name); break;
+        case draw_rectangle_field::y: args.y = fi.as_uint16_or_throw(name); break;
+        case draw_rectangle_field::width: args.width = fi.as_uint16_or_throw(name); break;
+        case draw_rectangle_field::height: args.height = fi.as_uint16_or_throw(name); break;
+        case draw_rectangle_field::color: args.color = rgb_color(fi.val()); break;
+        case draw_rectangle_field::line_width: args.lineWidth = ungarble_float(fi.val(), name); break;
+        }
+    }, handle_required ? static_cast<int>(draw_rectangle_field::handle) : -1);
+    return args;
+}
+
+inline bool parse_draw_rectangle_flat(sl::io::span<const char> data, draw_rectangle_args& args) {
+    auto& schema = draw_rectangle_schema();
+    flat_json_reader reader(data);
+    if (!reader.begin_object()) {
+        return false;
+    }
+    uint32_t seen = 0;
+    auto name = sl::io::span<const char>(nullptr, 0);
+    while (reader.next_field(name)) {
+        int id = schema.find(name.data(), name.size());
+        bool ok = false;
+        switch (static_cast<draw_rectangle_field>(id)) {
+        case draw_rectangle_field::handle: ok = reader.read_int64(args.handle); break;
+        case draw_rectangle_field::x: ok = reader.read_uint16(args.x); break;
+        case draw_rectangle_field::y: ok = reader.read_uint16(args.y); break;
+        case draw_rectangle_field::width: ok = reader.read_uint16(args.width); break;
+        case draw_rectangle_field::height: ok = reader.read_uint16(args.height); break;
+        case draw_rectangle_field::color: ok = read_flat_color(reader, args.color); break;
+        case draw_rectangle_field::line_width: ok = reader.read_float(args.lineWidth); break;
+        }
+        if (!ok || 0 != (seen & (1u << id))) {
+            return false;
+        }
+        seen |= (1u << id);
+    }
+    return reader.finished() && schema.has_required(seen);
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_FLAT_PARSERS_HPP */
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   font_stats.hpp
+ * Author: alex
+ *
+ * Created on October 31, 2020, 5:02 PM
+ */
+
+#ifndef WILTON_PDF_FONT_STATS_HPP
+#define WILTON_PDF_FONT_STATS_HPP
+
+#include <cstdint>
+#include <atomic>
+
+#include "staticlib/json.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Process-wide statistics of TrueType font loads. Haru cannot share
+ * parsed font data between documents, so every document parses its
+ * fonts itself and parsed data is charged to the memory of that document.
+ * Repeated loads of the same unchanged file into the same document, and
+ * loads into pre-built documents that already have the font, are served
+ * from the per-document memo without parsing.
+ */
+class font_stats {
+    std::atomic<uint64_t> reused;
+    std::atomic<uint64_t> parses;
+    // charged to documents by haru while parsing
+    std::atomic<uint64_t> parsed_bytes;
+
+public:
+    font_stats() :
+    reused(0),
+    parses(0),
+    parsed_bytes(0) { }
+
+    font_stats(const font_stats&) = delete;
+
+    font_stats& operator=(const font_stats&) = delete;
+
+    void record_parsed(uint64_t memory_bytes) {
+        parses.fetch_add(1, std::memory_order_relaxed);
+        parsed_bytes.fetch_add(memory_bytes, std::memory_order_relaxed);
+    }
+
+    void record_reused() {
+        reused.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    sl::json::value stats() {
+        return {
+            { "loadsReused", static_cast<int64_t>(reused.load(std::memory_order_relaxed)) },
+            { "parses", static_cast<int64_t>(parses.load(std::memory_order_relaxed)) },
+            { "parsedBytes", static_cast<int64_t>(parsed_bytes.load(std::memory_order_relaxed)) }
+        };
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_FONT_STATS_HPP */
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   hex_decoder.hpp
+ * Author: alex
+ *
+ * Created on November 23, 2020, 2:37 PM
+ */
+
+#ifndef WILTON_PDF_HEX_DECODER_HPP
+#define WILTON_PDF_HEX_DECODER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WILTON_PDF_HEX_SSE2
+#include <emmintrin.h>
+#endif // SSE2
+
+#include "staticlib/io.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+namespace wilton {
+namespace pdf {
+
+namespace hex_detail {
+
+inline int digit_value(char ch) {
+    auto uch = static_cast<unsigned char>(ch);
+    if (uch >= '0' && uch <= '9') {
+        return uch - '0';
+    }
+    unsigned char lower = uch | 0x20;
+    if (lower >= 'a' && lower <= 'f') {
+        return lower - 'a' + 10;
+    }
+    return -1;
+}
+
+// decodes pairs starting from the specified position, throws on invalid digit
+inline void decode_scalar(const char* hex, size_t len, size_t from, char* out) {
+    for (size_t i = from; i < len; i += 2) {
+        int high = digit_value(hex[i]);
+        int low = digit_value(hex[i + 1]);
+        if (-1 == high || -1 == low) {
+            size_t pos = -1 == high ? i : i + 1;
+            throw support::exception(TRACEMSG("Invalid hex digit specified," +
+                    " position: [" + sl::support::to_string(pos) + "]," +
+                    " code: [" + sl::support::to_string(static_cast<int>(static_cast<unsigned char>(hex[pos]))) + "]"));
+        }
+        out[i / 2] = static_cast<char>((high << 4) | low);
+    }
+}
+
+#ifdef WILTON_PDF_HEX_SSE2
+
+// 16 hex chars to 8 bytes in the low halves of 16-bit lanes,
+// 'valid' gets 0xffff if all chars are hex digits
+inline __m128i decode_block(__m128i chars, int& valid) {
+    const __m128i zero_minus_one = _mm_set1_epi8('0' - 1);
+    const __m128i nine_plus_one = _mm_set1_epi8('9' + 1);
+    const __m128i a_minus_one = _mm_set1_epi8('a' - 1);
+    const __m128i f_plus_one = _mm_set1_epi8('f' + 1);
+    // chars >= 0x80 are negative here and fail both range checks
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(chars, zero_minus_one),
+            _mm_cmplt_epi8(chars, nine_plus_one));
+    __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, a_minus_one),
+            _mm_cmplt_epi8(lower, f_plus_one));
+    __m128i digits = _mm_and_si128(is_digit, _mm_sub_epi8(chars, _mm_set1_epi8('0')));
+    __m128i alphas = _mm_and_si128(is_alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)));
+    __m128i values = _mm_or_si128(digits, alphas);
+    valid = _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha));
+    // little-endian lane is (low << 8) | high
+    __m128i high = _mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00ff)), 4);
+    __m128i low = _mm_srli_epi16(values, 8);
+    return _mm_or_si128(high, low);
+}
+
+// returns number of chars decoded, stops before the first block with invalid chars
+inline size_t decode_sse2(const char* hex, size_t len, char* out) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        int valid_first = 0;
+        int valid_second = 0;
+        __m128i first = decode_block(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + i)), valid_first);
+        __m128i second = decode_block(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + i + 16)), valid_second);
+        if (0xffff != valid_first || 0xffff != valid_second) {
+            break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 2), _mm_packus_epi16(first, second));
+    }
+    return i;
+}
+
+#endif // WILTON_PDF_HEX_SSE2
+
+} // namespace
+
+/**
+ * Decodes hex string (in upper or lower case) into a buffer
+ * allocated once, uses SSE2 when it is available
+ *
+ * @param hex hex string
+ * @return decoded bytes
+ */
+inline std::vector<char> decode_hex(sl::io::span<const char> hex) {
+    if (0 != hex.size() % 2) throw support::exception(TRACEMSG(
+            "Invalid hex data specified, odd length: [" + sl::support::to_string(hex.size()) + "]"));
+    auto res = std::vector<char>(hex.size() / 2);
+    size_t decoded = 0;
+#ifdef WILTON_PDF_HEX_SSE2
+    decoded = hex_detail::decode_sse2(hex.data(), hex.size(), res.data());
+#endif // WILTON_PDF_HEX_SSE2
+    // tail, or the rest after invalid block to find the invalid digit
+    hex_detail::decode_scalar(hex.data(), hex.size(), decoded, res.data());
+    return res;
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_HEX_DECODER_HPP */
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   image_cache.hpp
+ * Author: alex
+ *
+ * Created on October 29, 2020, 7:12 PM
+ */
+
+#ifndef WILTON_PDF_IMAGE_CACHE_HPP
+#define WILTON_PDF_IMAGE_CACHE_HPP
+
+#include <cstdint>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "staticlib/json.hpp"
+
+#include "file_contents.hpp"
+#include "png_checker.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Validated image data
+ */
+class cached_image {
+public:
+    // file contents read into memory, released for invalid images
+    std::unique_ptr<file_contents> contents;
+    // fingerprint of the file the contents were read from
+    std::string fingerprint;
+    // hash of the file contents
+    std::string hash;
+    // decoded image for valid PNG files, pixels of palette images
+    // are not stored, such images are decoded by haru on embedding
+    std::shared_ptr<const decoded_png> png;
+    // validation error message, empty for valid images
+    std::string error;
+};
+
+/**
+ * Process-wide LRU cache of image files contents, that were read
+ * and validated, entries are identified by file fingerprints
+ * and image format. Size of the cache is limited by the total
+ * size of cached data.
+ */
+class image_cache {
+    struct entry {
+        std::string key;
+        std::shared_ptr<const cached_image> image;
+    };
+
+    std::mutex mtx;
+    // most recently used entries first
+    std::list<entry> lru;
+    std::unordered_map<std::string, std::list<entry>::iterator> index;
+    uint64_t max_bytes;
+    uint64_t cur_bytes = 0;
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+public:
+    explicit image_cache(uint64_t max_bytes) :
+    max_bytes(max_bytes),
+    hits(0),
+    misses(0) { }
+
+    image_cache(const image_cache&) = delete;
+
+    image_cache& operator=(const image_cache&) = delete;
+
+    std::shared_ptr<const cached_image> get(const std::string& key) {
+        std::lock_guard<std::mutex> guard{mtx};
+        auto it = index.find(key);
+        if (index.end() == it) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return std::shared_ptr<const cached_image>();
+        }
+        hits.fetch_add(1, std::memory_order_relaxed);
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->image;
+    }
+
+    void put(const std::string& key, std::shared_ptr<const cached_image> image) {
+        uint64_t size = entry_size(key, *image);
+        std::lock_guard<std::mutex> guard{mtx};
+        if (size > max_bytes) {
+            return;
+        }
+        auto existing = index.find(key);
+        if (index.end() != existing) {
+            cur_bytes -= entry_size(key, *existing->second->image);
+            lru.erase(existing->second);
+            index.erase(existing);
+        }
+        lru.push_front(entry());
+        lru.front().key = key;
+        lru.front().image = std::move(image);
+        index.emplace(key, lru.begin());
+        cur_bytes += size;
+        evict();
+    }
+
+    void set_max_bytes(uint64_t max) {
+        std::lock_guard<std::mutex> guard{mtx};
+        max_bytes = max;
+        evict();
+    }
+
+    sl::json::value stats() {
+        std::lock_guard<std::mutex> guard{mtx};
+        return {
+            { "hits", static_cast<int64_t>(hits.load(std::memory_order_relaxed)) },
+            { "misses", static_cast<int64_t>(misses.load(std::memory_order_relaxed)) },
+            { "entries", static_cast<int64_t>(index.size()) },
+            { "bytes", static_cast<int64_t>(cur_bytes) },
+            { "maxBytes", static_cast<int64_t>(max_bytes) }
+        };
+    }
+
+private:
+    static uint64_t entry_size(const std::string& key, const cached_image& image) {
+        uint64_t data_size = nullptr != image.contents.get() ? image.contents->size() : 0;
+        uint64_t png_size = nullptr != image.png.get() ? image.png->size() : 0;
+        return static_cast<uint64_t>(key.size() + image.hash.size() + image.error.size()) +
+                data_size + png_size;
+    }
+
+    // must be called under lock
+    void evict() {
+        while (cur_bytes > max_bytes && !lru.empty()) {
+            auto& last = lru.back();
+            cur_bytes -= entry_size(last.key, *last.image);
+            index.erase(last.key);
+            lru.pop_back();
+        }
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_IMAGE_CACHE_HPP */
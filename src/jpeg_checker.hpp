@@ -44,6 +44,8 @@ namespace { // anonymous
 struct error_mgr {
     struct jpeg_error_mgr pub;
     jmp_buf jmpbuf;
+    // first corrupt-data warning, empty if none
+    char warning[JMSG_LENGTH_MAX];
 };
 
 void error_cb(j_common_ptr cinfo) {
@@ -55,14 +57,31 @@ void message_cb(j_common_ptr) {
     // no-op
 }
 
+// libjpeg recovers from corrupt or truncated scan data with a warning
+void emit_cb(j_common_ptr cinfo, int msg_level) {
+    auto emgr_ptr = reinterpret_cast<error_mgr*>(cinfo->err);
+    if (-1 == msg_level && '\0' == emgr_ptr->warning[0]) {
+        (emgr_ptr->pub.format_message)(cinfo, emgr_ptr->warning);
+    }
+}
+
 } // namespace
 
+/**
+ * Decodes the whole image, JPEG data is embedded as is and haru reads
+ * only its headers, so scan data is checked here; corrupt or truncated
+ * scan data is rejected
+ *
+ * @param span JPEG data
+ */
 void check_jpeg_valid(sl::io::span<char> span) {
     struct jpeg_decompress_struct cinfo;
     struct error_mgr emgr;
     cinfo.err = jpeg_std_error(std::addressof(emgr.pub));
     emgr.pub.error_exit = error_cb;
     emgr.pub.output_message = message_cb;
+    emgr.pub.emit_message = emit_cb;
+    emgr.warning[0] = '\0';
     jpeg_create_decompress(std::addressof(cinfo));
     auto deferred = sl::support::defer([&cinfo]() STATICLIB_NOEXCEPT {
         jpeg_destroy_decompress(std::addressof(cinfo));
@@ -88,7 +107,15 @@ void check_jpeg_valid(sl::io::span<char> span) {
         msg.resize(std::strlen(msg.c_str()));
         throw support::exception(TRACEMSG("JPEG read error, message: [" + msg + "]"));
     }
- 
+    if ('\0' != emgr.warning[0]) throw support::exception(TRACEMSG(
+            "JPEG read error, corrupt data, message: [" + std::string(emgr.warning) + "]"));
+    // haru embeds only gray, RGB and CMYK images
+    auto comps = cinfo.num_components;
+    if (0 == cinfo.image_width || 0 == cinfo.image_height ||
+            (1 != comps && 3 != comps && 4 != comps)) throw support::exception(TRACEMSG(
+            "JPEG error, unsupported image, width: [" + sl::support::to_string(cinfo.image_width) + "]," +
+            " height: [" + sl::support::to_string(cinfo.image_height) + "]," +
+            " components: [" + sl::support::to_string(comps) + "]"));
 }
 
 } // namespace
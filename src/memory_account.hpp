@@ -0,0 +1,276 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   memory_account.hpp
+ * Author: alex
+ *
+ * Created on November 6, 2020, 4:38 PM
+ */
+
+#ifndef WILTON_PDF_MEMORY_ACCOUNT_HPP
+#define WILTON_PDF_MEMORY_ACCOUNT_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <string>
+
+#include "hpdf.h"
+
+#include "staticlib/config.hpp"
+
+#include "wilton/support/exception.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Memory allocated by haru for a single document
+ */
+class memory_account {
+public:
+    std::atomic<uint64_t> used;
+    // set when allocation was refused because of the limits
+    std::atomic<bool> limit_exceeded;
+
+    memory_account() :
+    used(0),
+    limit_exceeded(false) { }
+
+    memory_account(const memory_account&) = delete;
+
+    memory_account& operator=(const memory_account&) = delete;
+};
+
+/**
+ * Process-wide memory usage and limits, zero limit means no limit
+ */
+class memory_limits {
+public:
+    static std::atomic<uint64_t>& total_used() {
+        static std::atomic<uint64_t> val(0);
+        return val;
+    }
+
+    static std::atomic<uint64_t>& document_limit() {
+        static std::atomic<uint64_t> val(0);
+        return val;
+    }
+
+    static std::atomic<uint64_t>& global_limit() {
+        static std::atomic<uint64_t> val(0);
+        return val;
+    }
+
+    // pixels of a single decoded image, checked before allocation
+    static std::atomic<uint64_t>& decoded_image_limit() {
+        static std::atomic<uint64_t> val(1 << 27);
+        return val;
+    }
+};
+
+/**
+ * Account that haru allocations in the current thread are charged to
+ */
+inline memory_account*& current_memory_account() {
+    static thread_local memory_account* account = nullptr;
+    return account;
+}
+
+/**
+ * Charges haru allocations in the current thread to the specified
+ * account while in scope
+ */
+class memory_scope {
+    memory_account* prev;
+
+public:
+    explicit memory_scope(memory_account* account) :
+    prev(current_memory_account()) {
+        current_memory_account() = account;
+    }
+
+    memory_scope(const memory_scope&) = delete;
+
+    memory_scope& operator=(const memory_scope&) = delete;
+
+    ~memory_scope() STATICLIB_NOEXCEPT {
+        current_memory_account() = prev;
+    }
+};
+
+namespace memory_detail {
+
+// keeps returned memory aligned for any type
+const size_t memory_header_size = 16;
+
+struct memory_header {
+    memory_account* account;
+    uint64_t size;
+};
+
+static_assert(sizeof(memory_header) <= memory_header_size, "Invalid memory header size");
+
+inline bool memory_reserve(std::atomic<uint64_t>& counter, uint64_t size, uint64_t limit) {
+    uint64_t prev = counter.fetch_add(size, std::memory_order_relaxed);
+    if (0 != limit && prev + size > limit) {
+        counter.fetch_sub(size, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * Memory limit error, depends on current usage and
+ * configuration, not on the input
+ */
+class memory_limit_exception : public support::exception {
+public:
+    explicit memory_limit_exception(const std::string& msg) :
+    support::exception(msg) { }
+};
+
+/**
+ * Memory allocated outside of haru, is charged to the current account
+ * and to the process-wide usage until the reservation is destroyed
+ */
+class memory_reservation {
+    memory_account* account = nullptr;
+    uint64_t size = 0;
+
+public:
+    memory_reservation() { }
+
+    memory_reservation(const memory_reservation&) = delete;
+
+    memory_reservation& operator=(const memory_reservation&) = delete;
+
+    memory_reservation(memory_reservation&& other) STATICLIB_NOEXCEPT :
+    account(other.account),
+    size(other.size) {
+        other.account = nullptr;
+        other.size = 0;
+    }
+
+    memory_reservation& operator=(memory_reservation&& other) STATICLIB_NOEXCEPT {
+        release();
+        account = other.account;
+        size = other.size;
+        other.account = nullptr;
+        other.size = 0;
+        return *this;
+    }
+
+    ~memory_reservation() STATICLIB_NOEXCEPT {
+        release();
+    }
+
+    /**
+     * Charges the specified size replacing previous reservation
+     *
+     * @param bytes size to charge
+     * @return false if document or global limit would be exceeded
+     */
+    bool reserve(uint64_t bytes) {
+        release();
+        auto acc = current_memory_account();
+        if (nullptr != acc && !memory_detail::memory_reserve(acc->used, bytes,
+                memory_limits::document_limit().load(std::memory_order_relaxed))) {
+            return false;
+        }
+        if (!memory_detail::memory_reserve(memory_limits::total_used(), bytes,
+                memory_limits::global_limit().load(std::memory_order_relaxed))) {
+            if (nullptr != acc) {
+                acc->used.fetch_sub(bytes, std::memory_order_relaxed);
+            }
+            return false;
+        }
+        account = acc;
+        size = bytes;
+        return true;
+    }
+
+private:
+    void release() STATICLIB_NOEXCEPT {
+        if (0 == size) {
+            return;
+        }
+        if (nullptr != account) {
+            account->used.fetch_sub(size, std::memory_order_relaxed);
+        }
+        memory_limits::total_used().fetch_sub(size, std::memory_order_relaxed);
+        account = nullptr;
+        size = 0;
+    }
+};
+
+/**
+ * Haru allocation function, allocations that exceed limits are refused,
+ * haru reports them as allocation errors
+ */
+inline void* accounted_alloc(HPDF_UINT size) {
+    auto account = current_memory_account();
+    auto total = static_cast<uint64_t>(size) + memory_detail::memory_header_size;
+    if (nullptr != account && !memory_detail::memory_reserve(account->used, total,
+            memory_limits::document_limit().load(std::memory_order_relaxed))) {
+        account->limit_exceeded.store(true, std::memory_order_relaxed);
+        return nullptr;
+    }
+    if (!memory_detail::memory_reserve(memory_limits::total_used(), total,
+            memory_limits::global_limit().load(std::memory_order_relaxed))) {
+        if (nullptr != account) {
+            account->used.fetch_sub(total, std::memory_order_relaxed);
+            account->limit_exceeded.store(true, std::memory_order_relaxed);
+        }
+        return nullptr;
+    }
+    auto mem = static_cast<char*>(std::malloc(static_cast<size_t>(total)));
+    if (nullptr == mem) {
+        if (nullptr != account) {
+            account->used.fetch_sub(total, std::memory_order_relaxed);
+        }
+        memory_limits::total_used().fetch_sub(total, std::memory_order_relaxed);
+        return nullptr;
+    }
+    auto header = reinterpret_cast<memory_detail::memory_header*>(mem);
+    header->account = account;
+    header->size = total;
+    return mem + memory_detail::memory_header_size;
+}
+
+/**
+ * Haru free function, memory is returned to the account it was charged to
+ */
+inline void accounted_free(void* ptr) {
+    if (nullptr == ptr) {
+        return;
+    }
+    auto mem = static_cast<char*>(ptr) - memory_detail::memory_header_size;
+    auto header = reinterpret_cast<memory_detail::memory_header*>(mem);
+    if (nullptr != header->account) {
+        header->account->used.fetch_sub(header->size, std::memory_order_relaxed);
+    }
+    memory_limits::total_used().fetch_sub(header->size, std::memory_order_relaxed);
+    std::free(mem);
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_MEMORY_ACCOUNT_HPP */
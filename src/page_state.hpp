@@ -0,0 +1,65 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   page_state.hpp
+ * Author: alex
+ *
+ * Created on December 16, 2020, 10:42 AM
+ */
+
+#ifndef WILTON_PDF_PAGE_STATE_HPP
+#define WILTON_PDF_PAGE_STATE_HPP
+
+#include "hpdf.h"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Clears document error and closes text or path object, that was left
+ * open on the current page by the failed operation, so the next
+ * operations start in page description mode
+ *
+ * @param doc haru document
+ * @return false if the page cannot be returned to page description mode
+ */
+inline bool restore_page_state(HPDF_Doc doc) {
+    HPDF_ResetError(doc);
+    HPDF_Page page = HPDF_GetCurrentPage(doc);
+    if (nullptr == page) {
+        return true;
+    }
+    try {
+        switch (HPDF_Page_GetGMode(page)) {
+        case HPDF_GMODE_TEXT_OBJECT: HPDF_Page_EndText(page); break;
+        case HPDF_GMODE_PATH_OBJECT: HPDF_Page_EndPath(page); break;
+        }
+    } catch (...) {
+        // error handler may throw
+        HPDF_ResetError(doc);
+        return false;
+    }
+    bool restored = HPDF_OK == HPDF_GetError(doc) &&
+            HPDF_GMODE_PAGE_DESCRIPTION == HPDF_Page_GetGMode(page);
+    HPDF_ResetError(doc);
+    return restored;
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_PAGE_STATE_HPP */
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   pdf_document.hpp
+ * Author: alex
+ *
+ * Created on October 24, 2020, 3:52 PM
+ */
+
+#ifndef WILTON_PDF_PDF_DOCUMENT_HPP
+#define WILTON_PDF_PDF_DOCUMENT_HPP
+
+#include <cstdint>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hpdf.h"
+
+#include "staticlib/config.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "call_stats.hpp"
+#include "memory_account.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Image loaded into a document and the input data it was loaded from,
+ * input is compared with the new one when their hashes match
+ */
+struct loaded_image {
+    HPDF_Image image;
+    // keeps input data alive
+    std::shared_ptr<const void> owner;
+    const char* data;
+    size_t size;
+};
+
+/**
+ * Haru document and the resources loaded into it
+ */
+class pdf_context {
+public:
+    HPDF_Doc doc;
+    // memory allocated by haru for this document
+    std::shared_ptr<memory_account> memory;
+    // loaded images, index is used as an image ID
+    std::vector<HPDF_Image> images;
+    // loaded images by the hash of their input data
+    std::unordered_map<std::string, loaded_image> images_by_content;
+    // loaded TrueType font names by font file fingerprints
+    std::unordered_map<std::string, std::string> fonts_by_fingerprint;
+    // loaded font names by the aliases specified for them in render input
+    std::unordered_map<std::string, std::string> font_aliases;
+
+    pdf_context(HPDF_Doc doc, std::shared_ptr<memory_account> memory) :
+    doc(doc),
+    memory(std::move(memory)) { }
+
+    pdf_context(const pdf_context&) = delete;
+
+    pdf_context& operator=(const pdf_context&) = delete;
+
+    ~pdf_context() STATICLIB_NOEXCEPT {
+        // account is freed after the document
+        HPDF_Free(doc);
+    }
+};
+
+/**
+ * Registered document, haru document is not thread-safe, so all operations
+ * on it are serialized. Callers are queued and executed one by one in
+ * the order they were submitted in.
+ */
+class pdf_document {
+    std::unique_ptr<pdf_context> ctx;
+    // readable without waiting for the turn
+    std::shared_ptr<memory_account> memory;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint64_t next_ticket = 0;
+    uint64_t serving_ticket = 0;
+
+    class turn {
+        pdf_document& pdoc;
+
+    public:
+        turn(pdf_document& pdoc) :
+        pdoc(pdoc) {
+            std::unique_lock<std::mutex> guard{pdoc.mtx};
+            uint64_t ticket = pdoc.next_ticket++;
+            pdoc.cv.wait(guard, [this, ticket] {
+                return ticket == this->pdoc.serving_ticket;
+            });
+        }
+
+        turn(const turn&) = delete;
+
+        turn& operator=(const turn&) = delete;
+
+        ~turn() STATICLIB_NOEXCEPT {
+            {
+                std::lock_guard<std::mutex> guard{pdoc.mtx};
+                pdoc.serving_ticket += 1;
+            }
+            pdoc.cv.notify_all();
+        }
+    };
+
+public:
+    explicit pdf_document(std::unique_ptr<pdf_context> ctx) :
+    ctx(std::move(ctx)),
+    memory(this->ctx->memory) { }
+
+    pdf_document(const pdf_document&) = delete;
+
+    pdf_document& operator=(const pdf_document&) = delete;
+
+    /**
+     * Waits for the previously submitted operations to complete
+     * and runs the specified one
+     *
+     * @param fun operation to run on document context
+     * @return operation result
+     */
+    template<typename Func>
+    auto execute(Func fun) -> decltype(fun(std::declval<pdf_context&>())) {
+        turn tu(*this);
+        if (nullptr == ctx.get()) throw support::exception(TRACEMSG(
+                "Invalid 'pdfDocumentHandle' parameter specified, document is already destroyed"));
+        memory_scope scope(ctx->memory.get());
+        phase_scope phase(call_phase::haru);
+        return fun(*ctx);
+    }
+
+    /**
+     * Waits for the previously submitted operations to complete
+     * and frees the haru document, operations submitted after this
+     * one will fail
+     */
+    void destroy() {
+        turn tu(*this);
+        if (nullptr == ctx.get()) throw support::exception(TRACEMSG(
+                "Invalid 'pdfDocumentHandle' parameter specified, document is already destroyed"));
+        ctx.reset();
+    }
+
+    /**
+     * Returns number of bytes currently allocated by haru for this document
+     *
+     * @return allocated bytes
+     */
+    uint64_t memory_used() const {
+        return memory->used.load(std::memory_order_relaxed);
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_PDF_DOCUMENT_HPP */
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   pdf_template.hpp
+ * Author: alex
+ *
+ * Created on November 4, 2020, 8:11 PM
+ */
+
+#ifndef WILTON_PDF_PDF_TEMPLATE_HPP
+#define WILTON_PDF_PDF_TEMPLATE_HPP
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "staticlib/json.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "document_pool.hpp"
+#include "pdf_document.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Checks whether the specified batched op only changes document contents,
+ * template ops are replayed off the caller thread for every built document,
+ * so ops with side effects outside of the document are not allowed
+ *
+ * @param op op name
+ * @return true for content ops
+ */
+inline bool is_template_op(const std::string& op) {
+    return "add_page" == op ||
+            "load_font" == op ||
+            "load_image" == op ||
+            "write_text" == op ||
+            "write_text_inside_rectangle" == op ||
+            "draw_line" == op ||
+            "draw_rectangle" == op ||
+            "draw_image" == op;
+}
+
+/**
+ * Checks names of the template ops, malformed op entries
+ * are reported when ops are applied
+ *
+ * @param ops list of op entries: {"op": "add_page", "args": {...}}
+ */
+inline void check_template_ops(const sl::json::value& ops) {
+    auto& list = ops.as_array();
+    for (size_t i = 0; i < list.size(); i++) {
+        auto& op = list[i]["op"];
+        if (sl::json::type::string == op.json_type() && !is_template_op(op.as_string())) {
+            throw support::exception(TRACEMSG(
+                    "Unsupported op for template: [" + op.as_string() + "]," +
+                    " only document content ops are allowed, index: [" + sl::support::to_string(i) + "]"));
+        }
+    }
+}
+
+/**
+ * Shared document prefix, haru documents cannot be copied, so the prefix
+ * is kept as a list of operations, that is replayed into new documents
+ * ahead of time by the pool of the template.
+ */
+class pdf_template {
+    std::function<std::unique_ptr<pdf_context>()> factory;
+    // results of prefix operations, same for every built document
+    sl::json::value results;
+    std::shared_ptr<document_pool> pool;
+    // document built with the template, when it is not pooled
+    std::mutex mtx;
+    std::unique_ptr<pdf_context> spare;
+
+public:
+    /**
+     * Constructor
+     *
+     * @param fac builds new document with the prefix applied
+     * @param results results of prefix operations
+     * @param first document built while collecting the results
+     * @param pool_size number of documents to keep ready
+     * @param refiller refiller thread for the pool
+     */
+    pdf_template(std::function<std::unique_ptr<pdf_context>()> fac, sl::json::value results,
+            std::unique_ptr<pdf_context> first, size_t pool_size, std::shared_ptr<pool_refiller> refiller) :
+    factory(fac),
+    results(std::move(results)),
+    pool(std::make_shared<document_pool>(refiller)) {
+        pool->configure(pool_size, std::move(fac));
+        spare = pool->offer(std::move(first));
+        refiller->add(pool);
+    }
+
+    pdf_template(const pdf_template&) = delete;
+
+    pdf_template& operator=(const pdf_template&) = delete;
+
+    /**
+     * Returns new document with the prefix applied, pre-built one
+     * is used if available
+     *
+     * @return document
+     */
+    std::unique_ptr<pdf_context> fork() {
+        auto res = pool->take();
+        if (nullptr == res.get()) {
+            std::lock_guard<std::mutex> guard{mtx};
+            res = std::move(spare);
+        }
+        if (nullptr == res.get()) {
+            res = factory();
+        }
+        return res;
+    }
+
+    const sl::json::value& prefix_results() const {
+        return results;
+    }
+
+    sl::json::value stats() {
+        return pool->stats();
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_PDF_TEMPLATE_HPP */
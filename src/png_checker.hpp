@@ -37,6 +37,10 @@
 #include "staticlib/io.hpp"
 #include "staticlib/support.hpp"
 
+#include "wilton/support/exception.hpp"
+
+#include "memory_account.hpp"
+
 namespace wilton {
 namespace pdf {
 
@@ -99,17 +103,72 @@ void png_error_cb(png_structp png_ptr, const char* msg) {
 
 } // namespace
 
-void check_png_valid(sl::io::span<char> span) {
-    auto src = sl::io::array_source(span);
+/**
+ * PNG image decoded to 8-bit gray or RGB pixels, transparency
+ * is split into a separate 8-bit mask
+ */
+struct decoded_png {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // 1 for gray, 3 for RGB
+    uint32_t color_channels = 0;
+    // pixels of palette images are checked but not stored,
+    // such images are embedded by haru to keep indexed colors
+    bool palette = false;
+    std::vector<unsigned char> pixels;
+    // empty for images without transparency
+    std::vector<unsigned char> alpha;
+    // pixels and alpha are charged to the current memory account
+    memory_reservation reserved;
+
+    uint64_t size() const {
+        return static_cast<uint64_t>(pixels.size() + alpha.size());
+    }
+};
+
+/**
+ * Decoding state that is changed between 'setjmp' and 'longjmp',
+ * is allocated before 'setjmp' and is only accessed through a pointer
+ */
+struct png_decode_state {
+    sl::io::array_source src;
+    std::pair<sl::support::observer_ptr<sl::io::array_source>, std::string> read_ctx;
+    decoded_png res;
+    std::vector<png_bytep> rows;
+    size_t channels = 0;
+
+    explicit png_decode_state(sl::io::span<const char> span) :
+    src(span.data(), span.size()) {
+        read_ctx.first.reset(std::addressof(src));
+    }
+
+    png_decode_state(const png_decode_state&) = delete;
+
+    png_decode_state& operator=(const png_decode_state&) = delete;
+};
+
+/**
+ * Decodes PNG image, image data is read and checked,
+ * throws on invalid input. Image dimensions are limited to 65536,
+ * size of decoded pixels is checked against configured limits
+ * before allocation.
+ *
+ * @param span PNG data
+ * @param keep_pixels whether decoded pixels are required, rows are
+ *        decoded and discarded otherwise; rows of palette images
+ *        are always discarded
+ * @return decoded image
+ */
+inline decoded_png decode_png(sl::io::span<const char> span, bool keep_pixels) {
+    auto state = sl::support::make_unique<png_decode_state>(span);
+    png_decode_state* const st = state.get();
     // long jump setup for no-return err_cb
-    auto read_ctx = std::pair<sl::support::observer_ptr<sl::io::array_source>, std::string>();
-    read_ctx.first.reset(std::addressof(src));
     auto err_ctx = sl::support::make_unique<std::pair<std::jmp_buf, std::string>>();
     std::jmp_buf& jmpbuf = err_ctx->first;
     
     // check signature
     std::array<char, 8> sigbuf;
-    sl::io::read_all(src, {sigbuf.data(), sigbuf.size()});
+    sl::io::read_all(st->src, {sigbuf.data(), sigbuf.size()});
     auto sigbuf_ptr = reinterpret_cast<unsigned char*>(sigbuf.data());
     auto err_sig = png_sig_cmp(sigbuf_ptr, 0, sigbuf.size());
     if (0 != err_sig) throw support::exception(TRACEMSG(
@@ -131,31 +190,82 @@ void check_png_valid(sl::io::span<char> span) {
     if (nullptr == info_ptr || nullptr == end_info_ptr) throw support::exception(TRACEMSG(
             "Error creating PNG structs"));
 
-    auto row = std::vector<png_bytep>();
     // read info
     if (0 == setjmp(jmpbuf)) {
         // png_error() will be longjumping through this scope
         // auto vars with destructors are UB here
-        png_set_read_fn(png_ptr, std::addressof(read_ctx), png_src_read_cb);
+        png_set_read_fn(png_ptr, std::addressof(st->read_ctx), png_src_read_cb);
         png_set_sig_bytes(png_ptr, 8);
+        png_set_user_limits(png_ptr, 1<<16, 1<<16);
         png_read_info(png_ptr, info_ptr);
-        png_set_interlace_handling(png_ptr);
+        st->res.palette = PNG_COLOR_TYPE_PALETTE == png_get_color_type(png_ptr, info_ptr);
+        bool store = keep_pixels && !st->res.palette;
+        if (store) {
+            // low bit depths and tRNS chunk are expanded to 8-bit gray, RGB and alpha
+            png_set_expand(png_ptr);
+            png_set_strip_16(png_ptr);
+        }
+        int passes = png_set_interlace_handling(png_ptr);
         png_read_update_info(png_ptr, info_ptr);
 
         // read data
         size_t height = png_get_image_height(png_ptr, info_ptr);
         size_t width = png_get_image_width(png_ptr, info_ptr);
-        if (width > 1<<16) throw support::exception(TRACEMSG(
-                "PNG error, invalid image width: [" + sl::support::to_string(width) + "]"));
-        row.resize(width);
-        for (size_t i = 0; i < height; i++) {
-            png_read_rows(png_ptr, row.data(), nullptr, 1);
+        st->res.width = static_cast<uint32_t>(width);
+        st->res.height = static_cast<uint32_t>(height);
+        if (store) {
+            st->channels = png_get_channels(png_ptr, info_ptr);
+            size_t row_bytes = png_get_rowbytes(png_ptr, info_ptr);
+            // header values are checked before any image data is read
+            uint64_t limit = memory_limits::decoded_image_limit().load(std::memory_order_relaxed);
+            uint64_t max = 0 != limit && limit < SIZE_MAX ? limit : SIZE_MAX;
+            if (row_bytes > max / height) throw memory_limit_exception(TRACEMSG(
+                    "PNG error, decoded image size exceeds limit: [" + sl::support::to_string(limit) + "]," +
+                    " width: [" + sl::support::to_string(width) + "]," +
+                    " height: [" + sl::support::to_string(height) + "]"));
+            size_t pixels_bytes = row_bytes * height;
+            uint64_t alpha_bytes = 0 == st->channels % 2 ? static_cast<uint64_t>(width) * height : 0;
+            if (!st->res.reserved.reserve(pixels_bytes + alpha_bytes)) throw memory_limit_exception(TRACEMSG(
+                    "PNG error, memory limit exceeded decoding image," +
+                    " bytes required: [" + sl::support::to_string(pixels_bytes + alpha_bytes) + "]"));
+            st->res.pixels.resize(pixels_bytes);
+            st->rows.resize(height);
+            for (size_t i = 0; i < height; i++) {
+                st->rows[i] = st->res.pixels.data() + i * row_bytes;
+            }
+            png_read_image(png_ptr, st->rows.data());
+        } else {
+            // every pass of interlaced image is read row by row
+            for (size_t i = 0; i < height * static_cast<size_t>(passes); i++) {
+                png_read_row(png_ptr, nullptr, nullptr);
+            }
         }
-        // read end info
         png_read_end(png_ptr, end_info_ptr);
     } else {
         throw support::exception(TRACEMSG("PNG read error, message: [" + err_ctx->second + "]"));
     }
+
+    // split alpha in place: gray+alpha or RGBA
+    if (st->channels > 0 && 0 == st->channels % 2) {
+        st->res.color_channels = static_cast<uint32_t>(st->channels - 1);
+        size_t count = static_cast<size_t>(st->res.width) * st->res.height;
+        st->res.alpha.resize(count);
+        unsigned char* px = st->res.pixels.data();
+        for (size_t i = 0; i < count; i++) {
+            for (size_t c = 0; c < st->res.color_channels; c++) {
+                px[i * st->res.color_channels + c] = px[i * st->channels + c];
+            }
+            st->res.alpha[i] = px[i * st->channels + st->res.color_channels];
+        }
+        st->res.pixels.resize(count * st->res.color_channels);
+    } else {
+        st->res.color_channels = static_cast<uint32_t>(st->channels);
+    }
+    return std::move(st->res);
+}
+
+inline void check_png_valid(sl::io::span<char> span) {
+    decode_png({span.data(), span.size()}, false);
 }
 
 } // namespace
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   prometheus_writer.hpp
+ * Author: alex
+ *
+ * Created on November 11, 2020, 6:17 PM
+ */
+
+#ifndef WILTON_PDF_PROMETHEUS_WRITER_HPP
+#define WILTON_PDF_PROMETHEUS_WRITER_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "staticlib/support.hpp"
+
+#include "call_stats.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Writes metrics in Prometheus text exposition format (version 0.0.4)
+ */
+class prometheus_writer {
+    std::string out;
+
+public:
+    prometheus_writer() { }
+
+    prometheus_writer(const prometheus_writer&) = delete;
+
+    prometheus_writer& operator=(const prometheus_writer&) = delete;
+
+    void family(const std::string& name, const std::string& type, const std::string& help) {
+        out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+        out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    }
+
+    void sample(const std::string& name, const std::string& labels, const std::string& value) {
+        out.append(name);
+        if (!labels.empty()) {
+            out.append("{").append(labels).append("}");
+        }
+        out.append(" ").append(value).append("\n");
+    }
+
+    void sample(const std::string& name, const std::string& labels, uint64_t value) {
+        sample(name, labels, sl::support::to_string(value));
+    }
+
+    void counter(const std::string& name, const std::string& help, uint64_t value) {
+        family(name, "counter", help);
+        sample(name, "", value);
+    }
+
+    void gauge(const std::string& name, const std::string& help, uint64_t value) {
+        family(name, "gauge", help);
+        sample(name, "", value);
+    }
+
+    /**
+     * Writes histogram samples, family must be written before,
+     * buckets are converted to cumulative ones in seconds
+     *
+     * @param name family name
+     * @param labels labels without braces
+     * @param hist histogram
+     */
+    void histogram(const std::string& name, const std::string& labels, const latency_histogram& hist) {
+        auto prefix = labels.empty() ? std::string() : labels + ",";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < latency_histogram::buckets_count - 1; i++) {
+            cumulative += hist.get_bucket(i);
+            sample(name + "_bucket", prefix + "le=\"" +
+                    micros_to_seconds(latency_histogram::bucket_bound_micros(i)) + "\"", cumulative);
+        }
+        cumulative += hist.get_bucket(latency_histogram::buckets_count - 1);
+        sample(name + "_bucket", prefix + "le=\"+Inf\"", cumulative);
+        sample(name + "_sum", labels, micros_to_seconds(hist.get_sum_micros()));
+        sample(name + "_count", labels, cumulative);
+    }
+
+    const std::string& str() const {
+        return out;
+    }
+
+    static std::string label(const std::string& name, const std::string& value) {
+        // label values used here are call and phase names, no escaping is needed
+        return name + "=\"" + value + "\"";
+    }
+
+private:
+    static std::string micros_to_seconds(uint64_t micros) {
+        auto res = sl::support::to_string(micros / 1000000);
+        uint64_t frac = micros % 1000000;
+        if (0 == frac) {
+            return res;
+        }
+        auto frac_str = sl::support::to_string(frac);
+        res.push_back('.');
+        res.append(6 - frac_str.length(), '0');
+        res.append(frac_str);
+        while ('0' == res.back()) {
+            res.pop_back();
+        }
+        return res;
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_PROMETHEUS_WRITER_HPP */
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   registered_buffer.hpp
+ * Author: alex
+ *
+ * Created on November 25, 2020, 6:40 PM
+ */
+
+#ifndef WILTON_PDF_REGISTERED_BUFFER_HPP
+#define WILTON_PDF_REGISTERED_BUFFER_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "staticlib/io.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "content_hash.hpp"
+#include "file_contents.hpp"
+#include "memory_account.hpp"
+#include "png_checker.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Binary data registered once and then referenced from calls
+ * by its ID, data is used in place without copying. Validation
+ * results are remembered for every image format, along with
+ * the image decoded during validation.
+ *
+ * Data registered from a file is read into its 'file_contents' and
+ * is kept for as long as the buffer is alive: while it is registered
+ * and while documents that embedded it hold a reference to it.
+ */
+class registered_buffer {
+    std::vector<char> bytes;
+    // set for data registered from a file, 'bytes' are empty then
+    std::unique_ptr<file_contents> contents;
+    std::string bytes_hash;
+    std::mutex mtx;
+    // format -> validation result
+    struct validation {
+        // error message, empty for valid data
+        std::string error;
+        std::shared_ptr<const decoded_png> png;
+    };
+    std::map<std::string, validation> validated;
+
+public:
+    explicit registered_buffer(std::vector<char>&& buffer) :
+    bytes(std::move(buffer)),
+    bytes_hash(content_hash(data())) { }
+
+    explicit registered_buffer(std::unique_ptr<file_contents>&& file) :
+    contents(std::move(file)),
+    bytes_hash(content_hash(data())) { }
+
+    registered_buffer(const registered_buffer&) = delete;
+
+    registered_buffer& operator=(const registered_buffer&) = delete;
+
+    sl::io::span<const char> data() const {
+        if (nullptr != contents.get()) {
+            const file_contents& fc = *contents;
+            return fc.data();
+        }
+        return {bytes.data(), bytes.size()};
+    }
+
+    size_t size() const {
+        return data().size();
+    }
+
+    const std::string& hash() const {
+        return bytes_hash;
+    }
+
+    /**
+     * Validates data as an image of the specified format, validation
+     * is performed only once per format, the check is not called
+     * for already validated formats. Memory limit failures are not
+     * remembered, validation is retried on the next call.
+     *
+     * @param format image format
+     * @param check validation functor accepting data span, throws on invalid data,
+     *        returns image decoded during validation or null
+     * @return image decoded during validation of this format, may be null
+     */
+    template<typename Check>
+    std::shared_ptr<const decoded_png> check_valid(const std::string& format, Check check) {
+        std::lock_guard<std::mutex> guard{mtx};
+        auto it = validated.find(format);
+        if (validated.end() == it) {
+            auto res = validation();
+            try {
+                res.png = check(mutable_data());
+            } catch (const memory_limit_exception&) {
+                // not a property of the data
+                throw;
+            } catch (const std::exception& e) {
+                res.error = TRACEMSG(e.what());
+            }
+            it = validated.emplace(format, std::move(res)).first;
+        }
+        if (!it->second.error.empty()) throw support::exception(TRACEMSG(it->second.error));
+        return it->second.png;
+    }
+
+private:
+    // checkers may require mutable span, file contents are owned
+    sl::io::span<char> mutable_data() {
+        if (nullptr != contents.get()) {
+            return contents->mutable_data();
+        }
+        return {bytes.data(), bytes.size()};
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_REGISTERED_BUFFER_HPP */
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   sharded_handle_registry.hpp
+ * Author: alex
+ *
+ * Created on October 22, 2020, 9:17 PM
+ */
+
+#ifndef WILTON_PDF_SHARDED_HANDLE_REGISTRY_HPP
+#define WILTON_PDF_SHARDED_HANDLE_REGISTRY_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Registry of shared objects, handle is an address of the registered object.
+ * Handles are spread over a number of independently locked shards,
+ * so threads working with different objects do not contend on
+ * a single lock.
+ */
+template<typename T>
+class sharded_handle_registry {
+    struct shard {
+        std::mutex mtx;
+        std::unordered_map<int64_t, std::shared_ptr<T>> registry;
+        // keeps neighbour shards locks on different cache lines
+        char padding[64];
+    };
+
+    size_t mask;
+    std::unique_ptr<shard[]> shards;
+
+public:
+    /**
+     * Constructor
+     *
+     * @param shards_count_hint number of shards, rounded up to the power of 2,
+     *        by default 4 shards are used per each hardware thread
+     */
+    explicit sharded_handle_registry(size_t shards_count_hint = 0) :
+    mask(shards_count(shards_count_hint) - 1),
+    shards(new shard[mask + 1]) { }
+
+    sharded_handle_registry(const sharded_handle_registry&) = delete;
+
+    sharded_handle_registry& operator=(const sharded_handle_registry&) = delete;
+
+    int64_t put(std::shared_ptr<T> obj) {
+        auto handle = reinterpret_cast<int64_t>(obj.get());
+        auto& sh = shards[shard_idx(handle)];
+        std::lock_guard<std::mutex> guard{sh.mtx};
+        sh.registry.emplace(handle, std::move(obj));
+        return handle;
+    }
+
+    /**
+     * Returns registered object leaving it in registry
+     *
+     * @param handle object handle
+     * @return object or empty pointer if handle is not registered
+     */
+    std::shared_ptr<T> peek(int64_t handle) {
+        auto& sh = shards[shard_idx(handle)];
+        std::lock_guard<std::mutex> guard{sh.mtx};
+        auto it = sh.registry.find(handle);
+        if (sh.registry.end() == it) {
+            return std::shared_ptr<T>();
+        }
+        return it->second;
+    }
+
+    /**
+     * Removes object from registry
+     *
+     * @param handle object handle
+     * @return object or empty pointer if handle is not registered
+     */
+    std::shared_ptr<T> remove(int64_t handle) {
+        auto& sh = shards[shard_idx(handle)];
+        std::lock_guard<std::mutex> guard{sh.mtx};
+        auto it = sh.registry.find(handle);
+        if (sh.registry.end() == it) {
+            return std::shared_ptr<T>();
+        }
+        auto res = std::move(it->second);
+        sh.registry.erase(it);
+        return res;
+    }
+
+    /**
+     * Returns all registered objects, shards are locked one at a time,
+     * so the result is not an atomic snapshot of the whole registry
+     *
+     * @return list of handles with objects
+     */
+    std::vector<std::pair<int64_t, std::shared_ptr<T>>> list() {
+        auto res = std::vector<std::pair<int64_t, std::shared_ptr<T>>>();
+        for (size_t i = 0; i <= mask; i++) {
+            auto& sh = shards[i];
+            std::lock_guard<std::mutex> guard{sh.mtx};
+            for (auto& en : sh.registry) {
+                res.emplace_back(en.first, en.second);
+            }
+        }
+        return res;
+    }
+
+private:
+    size_t shard_idx(int64_t handle) const {
+        // addresses are aligned, mix higher bits in
+        auto hash = static_cast<uint64_t>(handle);
+        hash ^= hash >> 17;
+        hash *= 0x9e3779b97f4a7c15ULL;
+        return static_cast<size_t>(hash >> 40) & mask;
+    }
+
+    static size_t shards_count(size_t hint) {
+        size_t target = hint;
+        if (0 == target) {
+            size_t hw = std::thread::hardware_concurrency();
+            target = (0 != hw ? hw : 4) * 4;
+        }
+        size_t res = 1;
+        while (res < target && res < (1 << 12)) {
+            res <<= 1;
+        }
+        return res;
+    }
+};
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_SHARDED_HANDLE_REGISTRY_HPP */
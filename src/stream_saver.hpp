@@ -0,0 +1,247 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   stream_saver.hpp
+ * Author: alex
+ *
+ * Created on October 20, 2020, 7:41 PM
+ */
+
+#ifndef WILTON_PDF_STREAM_SAVER_HPP
+#define WILTON_PDF_STREAM_SAVER_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "staticlib/config.hpp"
+
+#ifndef STATICLIB_WINDOWS
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif // !STATICLIB_WINDOWS
+
+#include "hpdf.h"
+
+#include "staticlib/io.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "memory_account.hpp"
+
+namespace wilton {
+namespace pdf {
+
+/**
+ * Haru errors in the current thread are recorded into the specified string
+ * instead of being thrown while in scope, haru then returns an error status
+ * and releases the resources it holds (i.e. closes output file)
+ */
+class haru_error_capture {
+    std::string* prev;
+
+public:
+    explicit haru_error_capture(std::string& errors) :
+    prev(current()) {
+        current() = std::addressof(errors);
+    }
+
+    haru_error_capture(const haru_error_capture&) = delete;
+
+    haru_error_capture& operator=(const haru_error_capture&) = delete;
+
+    ~haru_error_capture() STATICLIB_NOEXCEPT {
+        current() = prev;
+    }
+
+    static std::string*& current() {
+        static thread_local std::string* errors = nullptr;
+        return errors;
+    }
+};
+
+#ifndef STATICLIB_WINDOWS
+
+/**
+ * Blocks SIGPIPE in the current thread while in scope, so writes to
+ * a closed pipe or socket fail with EPIPE instead of killing the process,
+ * SIGPIPE raised in scope is discarded
+ */
+class sigpipe_guard {
+    sigset_t pipe_set;
+    sigset_t old_mask;
+    bool was_pending = false;
+
+public:
+    sigpipe_guard() {
+        sigemptyset(std::addressof(pipe_set));
+        sigaddset(std::addressof(pipe_set), SIGPIPE);
+        sigset_t pending;
+        sigemptyset(std::addressof(pending));
+        sigpending(std::addressof(pending));
+        was_pending = 1 == sigismember(std::addressof(pending), SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, std::addressof(pipe_set), std::addressof(old_mask));
+    }
+
+    sigpipe_guard(const sigpipe_guard&) = delete;
+
+    sigpipe_guard& operator=(const sigpipe_guard&) = delete;
+
+    ~sigpipe_guard() STATICLIB_NOEXCEPT {
+        if (!was_pending) {
+            sigset_t pending;
+            sigemptyset(std::addressof(pending));
+            sigpending(std::addressof(pending));
+            if (1 == sigismember(std::addressof(pending), SIGPIPE)) {
+                int sig = 0;
+                sigwait(std::addressof(pipe_set), std::addressof(sig));
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, std::addressof(old_mask), nullptr);
+    }
+};
+
+// fills the chunk until it is full or all writers closed the pipe
+inline size_t read_chunk(int fd, std::vector<char>& buf) {
+    size_t filled = 0;
+    while (filled < buf.size()) {
+        auto read = ::read(fd, buf.data() + filled, buf.size() - filled);
+        if (read < 0) {
+            if (EINTR == errno) continue;
+            throw support::exception(TRACEMSG("Error reading PDF pipe," +
+                    " error: [" + ::strerror(errno) + "]"));
+        }
+        if (0 == read) break;
+        filled += static_cast<size_t>(read);
+    }
+    return filled;
+}
+
+#endif // !STATICLIB_WINDOWS
+
+inline void write_to_fd(int fd, sl::io::span<const char> span) {
+#ifndef STATICLIB_WINDOWS
+    sigpipe_guard guard;
+    size_t written = 0;
+    while (written < span.size()) {
+        auto res = ::write(fd, span.data() + written, span.size() - written);
+        if (res < 0) {
+            if (EINTR == errno) continue;
+            throw support::exception(TRACEMSG("Error writing PDF output," +
+                    " fd: [" + sl::support::to_string(fd) + "]," +
+                    " error: [" + ::strerror(errno) + "]"));
+        }
+        written += static_cast<size_t>(res);
+    }
+#else // STATICLIB_WINDOWS
+    (void) fd;
+    (void) span;
+    throw support::exception(TRACEMSG("Writing to file descriptors is not supported on this platform"));
+#endif // !STATICLIB_WINDOWS
+}
+
+/**
+ * Saves the document passing the output to the sink in chunks of the
+ * specified size as haru serializes it. Haru file writer is run in a separate
+ * thread against the write end of a pipe, so neither the whole output
+ * nor its temporary file are materialized.
+ *
+ * @param doc document
+ * @param chunk_size size of all chunks except the last one, chunk buffer
+ *        is charged to the current memory account
+ * @param sink output sink
+ * @return number of bytes passed to sink
+ */
+inline uint64_t save_to_sink(HPDF_Doc doc, size_t chunk_size,
+        std::function<void(sl::io::span<const char>)> sink) {
+#ifndef STATICLIB_WINDOWS
+    // chunk buffer is charged to the document being saved
+    memory_reservation reserved;
+    if (!reserved.reserve(chunk_size)) throw memory_limit_exception(TRACEMSG(
+            "Memory limit exceeded allocating output chunk," +
+            " bytes required: [" + sl::support::to_string(chunk_size) + "]"));
+    int pipefd[2];
+    if (0 != ::pipe(pipefd)) throw support::exception(TRACEMSG(
+            "Error creating PDF pipe, error: [" + ::strerror(errno) + "]"));
+    int rfd = pipefd[0];
+    int wfd = pipefd[1];
+    auto wpath = std::string("/dev/fd/") + sl::support::to_string(wfd);
+    auto writer_err = std::string();
+    auto account = current_memory_account();
+    auto writer = std::thread([doc, &wpath, &writer_err, wfd, account]() {
+        memory_scope scope(account);
+        // reader closes the pipe on sink or read error
+        sigpipe_guard guard;
+        auto errors = std::string();
+        {
+            // haru must not be unwound by exception, it would leak the opened file
+            // and the pipe would never reach EOF
+            haru_error_capture capture(errors);
+            HPDF_STATUS status = HPDF_SaveToFile(doc, wpath.c_str());
+            if (HPDF_OK != status) {
+                HPDF_ResetError(doc);
+                writer_err = errors.empty() ? TRACEMSG("'HPDF_SaveToFile' error," +
+                        " code: [" + sl::support::to_string(status) + "]") : errors;
+            }
+        }
+        ::close(wfd);
+    });
+
+    // on sink or read error the read end is closed right away,
+    // so the writer fails fast with EPIPE instead of being drained
+    auto buf = std::vector<char>();
+    buf.resize(chunk_size);
+    auto reader_err = std::string();
+    uint64_t total = 0;
+    for (;;) {
+        try {
+            size_t filled = read_chunk(rfd, buf);
+            if (filled > 0) {
+                sink({buf.data(), filled});
+                total += filled;
+            }
+            if (filled < buf.size()) break;
+        } catch (const std::exception& e) {
+            reader_err = TRACEMSG(e.what());
+            break;
+        }
+    }
+    ::close(rfd);
+    writer.join();
+
+    // writer error is caused by the closed pipe in this case
+    if (!reader_err.empty()) throw support::exception(TRACEMSG(reader_err));
+    if (!writer_err.empty()) throw support::exception(TRACEMSG(writer_err));
+    return total;
+#else // STATICLIB_WINDOWS
+    (void) doc;
+    (void) chunk_size;
+    (void) sink;
+    throw support::exception(TRACEMSG("Streaming save is not supported on this platform"));
+#endif // !STATICLIB_WINDOWS
+}
+
+} // namespace
+}
+
+#endif /* WILTON_PDF_STREAM_SAVER_HPP */
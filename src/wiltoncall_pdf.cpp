@@ -20,7 +20,12 @@
  *
  * Created on September 30, 2017, 2:06 PM
  */
+#include <cstdlib>
+#include <climits>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <string>
@@ -34,14 +39,35 @@
 #include "staticlib/utils.hpp"
 #include "staticlib/tinydir.hpp"
 
+#include "wilton/wilton.h"
+
 #include "wilton/support/buffer.hpp"
 #include "wilton/support/exception.hpp"
-#include "wilton/support/unique_handle_registry.hpp"
 #include "wilton/support/registrar.hpp"
 
 #include "png_checker.hpp"
 // must go after png.h because of <setjmp> include order
 #include "jpeg_checker.hpp"
+#include "base64_decoder.hpp"
+#include "call_recorder.hpp"
+#include "call_stats.hpp"
+#include "content_hash.hpp"
+#include "document_pool.hpp"
+#include "field_schema.hpp"
+#include "file_contents.hpp"
+#include "file_fingerprint.hpp"
+#include "flat_parsers.hpp"
+#include "font_stats.hpp"
+#include "hex_decoder.hpp"
+#include "image_cache.hpp"
+#include "memory_account.hpp"
+#include "page_state.hpp"
+#include "pdf_document.hpp"
+#include "pdf_template.hpp"
+#include "prometheus_writer.hpp"
+#include "registered_buffer.hpp"
+#include "sharded_handle_registry.hpp"
+#include "stream_saver.hpp"
 
 namespace wilton {
 namespace pdf {
@@ -49,641 +75,1631 @@ namespace pdf {
 namespace { // anonymous
 
 // initialized from wilton_module_init
-std::shared_ptr<support::unique_handle_registry<_HPDF_Doc_Rec>> doc_registry() {
-    static auto registry = std::make_shared<support::unique_handle_registry<_HPDF_Doc_Rec>>(
-            [](HPDF_Doc doc) STATICLIB_NOEXCEPT {
-                HPDF_Free(doc);
-            });
+std::shared_ptr<sharded_handle_registry<pdf_document>> doc_registry() {
+    static auto registry = std::make_shared<sharded_handle_registry<pdf_document>>();
     return registry;
 }
 
-float ungarble_float(const sl::json::value& val, const std::string& context) {
-    float res = [&val, &context]() -> float {
-        switch(val.json_type()) {
-        case sl::json::type::real: return val.as_float_or_throw(context);
-        case sl::json::type::integer: return static_cast<float>(val.as_int64_or_throw(context));
-        default: throw support::exception(TRACEMSG(
-                "Invalid RGB color element specified," +
-                " type: [" + sl::json::stringify_json_type(val.json_type()) + "]," +
-                " value: [" + val.dumps() + "]"));
+// initialized from wilton_module_init
+std::shared_ptr<call_stats_registry> shared_call_stats() {
+    static auto stats = std::make_shared<call_stats_registry>();
+    return stats;
+}
+
+// initialized from wilton_module_init
+std::shared_ptr<module_counters> shared_counters() {
+    static auto counters = std::make_shared<module_counters>();
+    return counters;
+}
+
+// initialized from wilton_module_init
+std::shared_ptr<call_recorder> shared_recorder() {
+    static auto recorder = std::make_shared<call_recorder>();
+    return recorder;
+}
+
+// configure calls, that start or stop recording, are not recorded,
+// so replaying the log does not turn recording on
+bool changes_recording(const std::string& name, sl::io::span<const char> data) {
+    static const std::string marker = "\"recordPath\"";
+    if ("pdf_configure" != name) {
+        return false;
+    }
+    auto end = data.data() + data.size();
+    return end != std::search(data.data(), end, marker.begin(), marker.end());
+}
+
+// calls are measured with stats recorded for each registered name,
+// and are written to the call log when recording is enabled
+void register_call(const std::string& name, std::function<support::buffer(sl::io::span<const char>)> fun) {
+    auto stats = shared_call_stats()->add(name);
+    auto recorder = shared_recorder();
+    // handles from these outputs are mapped to new ones on replay
+    bool record_output = "pdf_create_document" == name ||
+            "pdf_create_template" == name ||
+            "pdf_fork_template" == name ||
+            "pdf_register_buffer" == name;
+    support::register_wiltoncall(name, [stats, fun, recorder, name, record_output](sl::io::span<const char> data) {
+        call_scope scope(*stats);
+        if (!recorder->is_active() || changes_recording(name, data)) {
+            auto res = fun(data);
+            scope.mark_success();
+            return res;
         }
-    } ();
-    return res;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            auto res = fun(data);
+            scope.mark_success();
+            auto output = std::string();
+            if (record_output && res.has_value()) {
+                output.assign(res.value().data(), res.value().size());
+            }
+            recorder->record(name, start, data, output, sl::utils::empty_string());
+            return res;
+        } catch (const std::exception& e) {
+            recorder->record(name, start, data, sl::utils::empty_string(), e.what());
+            throw;
+        }
+    });
+}
+
+sl::json::value load_json(sl::io::span<const char> data) {
+    phase_scope phase(call_phase::parse);
+    return sl::json::load(data);
+}
+
+std::shared_ptr<pdf_document> find_document(int64_t handle) {
+    auto reg = doc_registry();
+    auto pdoc = reg->peek(handle);
+    if (nullptr == pdoc.get()) throw support::exception(TRACEMSG(
+            "Invalid 'pdfDocumentHandle' parameter specified"));
+    return pdoc;
 }
 
+// initialized from wilton_module_init
+std::shared_ptr<image_cache> shared_image_cache() {
+    static auto cache = std::make_shared<image_cache>(64 * 1024 * 1024);
+    return cache;
+}
+
+// initialized from wilton_module_init
+std::shared_ptr<font_stats> shared_font_stats() {
+    static auto stats = std::make_shared<font_stats>();
+    return stats;
+}
+
+// initialized from wilton_module_init
+std::shared_ptr<sharded_handle_registry<registered_buffer>> buffer_registry() {
+    static auto registry = std::make_shared<sharded_handle_registry<registered_buffer>>();
+    return registry;
+}
+
+void check_image_valid(sl::io::span<char> span, const std::string& format) {
+    phase_scope phase(call_phase::validation);
+    try {
+        if ("PNG" == format) {
+            // explicit check is required because haru may crash on invalid PNG input
+            check_png_valid(span);
+        } else if("JPEG" == format) { 
+            // explicit check is required because haru moves doc into invalid state on
+            // invalid JPEG input, haru reads only JPEG headers
+            check_jpeg_valid(span);
+        } else throw support::exception(TRACEMSG("Unsupported image format: [" + format + "]"));
+    } catch (...) {
+        shared_counters()->validation_failures.fetch_add(1, std::memory_order_relaxed);
+        throw;
+    }
+}
+
+// decoding validates the image
+decoded_png decode_png_checked(sl::io::span<const char> span) {
+    phase_scope phase(call_phase::validation);
+    try {
+        return decode_png(span, true);
+    } catch (...) {
+        shared_counters()->validation_failures.fetch_add(1, std::memory_order_relaxed);
+        throw;
+    }
+}
+
+// decoded image is kept by the image cache or by the registered buffer
+// and is shared between documents, it is charged to process-wide
+// memory usage only
+std::shared_ptr<const decoded_png> decode_png_shared(sl::io::span<const char> span) {
+    memory_scope scope(nullptr);
+    return std::make_shared<decoded_png>(decode_png_checked(span));
+}
+
+// pixels are passed to haru as is, palette images are left to haru
+// to keep indexed color space in output, haru decodes them again
+HPDF_Image embed_png(HPDF_Doc doc, sl::io::span<const char> span, const decoded_png& png) {
+    shared_counters()->images_loaded.fetch_add(1, std::memory_order_relaxed);
+    if (png.palette) {
+        auto buf_ptr = reinterpret_cast<const unsigned char*>(span.data());
+        return HPDF_LoadPngImageFromMem(doc, buf_ptr, static_cast<HPDF_UINT>(span.size()));
+    }
+    auto cs = 1 == png.color_channels ? HPDF_CS_DEVICE_GRAY : HPDF_CS_DEVICE_RGB;
+    HPDF_Image image = HPDF_LoadRawImageFromMem(doc, png.pixels.data(), png.width, png.height, cs, 8);
+    if (nullptr != image && !png.alpha.empty()) {
+        HPDF_Image smask = HPDF_LoadRawImageFromMem(doc, png.alpha.data(), png.width, png.height,
+                HPDF_CS_DEVICE_GRAY, 8);
+        HPDF_Image_AddSMask(image, smask);
+    }
+    return image;
+}
+
+// input must be validated, haru reads only JPEG headers
+HPDF_Image embed_jpeg(HPDF_Doc doc, sl::io::span<const char> span) {
+    auto buf_ptr = reinterpret_cast<const unsigned char*>(span.data());
+    shared_counters()->images_loaded.fetch_add(1, std::memory_order_relaxed);
+    return HPDF_LoadJpegImageFromMem(doc, buf_ptr, static_cast<HPDF_UINT>(span.size()));
+}
+
+// non-palette PNG is decoded only once, for both validation and embedding
 HPDF_Image load_image_from_bytes(HPDF_Doc doc, sl::io::span<char> span, const std::string& format) {
     if ("PNG" == format) {
-        // explicit check is required because haru may crash on invalid PNG input
-        check_png_valid(span);
-    } else if("JPEG" == format) { 
-        // explicit check is required because haru moves doc into invalid state on
-        // invalid JPEG input
-        check_jpeg_valid(span);
-    } else throw support::exception(TRACEMSG("Unsupported image format: [" + format + "]"));
-    // note: currently there is no image reuse - it is loaded every time
-    auto buf_ptr = const_cast<const unsigned char*>(reinterpret_cast<unsigned char*>(span.data()));
-    if ("PNG" == format) {
-        return HPDF_LoadPngImageFromMem(doc, buf_ptr, static_cast<HPDF_UINT>(span.size()));
-    } else { // "JPEG"
-        return HPDF_LoadJpegImageFromMem(doc, buf_ptr, static_cast<HPDF_UINT>(span.size()));
+        return embed_png(doc, {span.data(), span.size()}, decode_png_checked({span.data(), span.size()}));
     }
+    check_image_valid(span, format);
+    return embed_jpeg(doc, {span.data(), span.size()});
 }
 
-HPDF_Image load_image_from_hex(HPDF_Doc doc, const std::string& image_hex, const std::string& format) {
-    // convert hex to binary
-    auto src_hex = sl::io::array_source(image_hex.data(), image_hex.length());
-    auto sink_bin = sl::io::make_array_sink();
+// valid PNG is decoded once and is cached along with the file contents
+std::shared_ptr<const cached_image> read_image_file(const std::string& image_path, const std::string& format) {
+    auto image = std::make_shared<cached_image>();
     {
-        auto src = sl::io::make_hex_source(src_hex);
-        sl::io::copy_all(src, sink_bin);
+        phase_scope phase(call_phase::io);
+        image->contents = sl::support::make_unique<file_contents>(image_path);
+    }
+    image->fingerprint = image->contents->fingerprint();
+    auto span = image->contents->mutable_data();
+    image->hash = content_hash({span.data(), span.size()});
+    try {
+        if ("PNG" == format) {
+            image->png = decode_png_shared({span.data(), span.size()});
+        } else {
+            check_image_valid(span, format);
+        }
+    } catch (const memory_limit_exception&) {
+        // not a property of the file, is not cached
+        throw;
+    } catch (const std::exception& e) {
+        image->error = TRACEMSG(e.what());
+        image->contents.reset();
+    }
+    return image;
+}
+
+// identical inputs are loaded only once per document,
+// hex and base64 inputs are hashed as is, before decoding;
+// inputs with the same hash are compared byte by byte
+HPDF_Image find_loaded_image(pdf_context& ctx, const std::string& key, sl::io::span<const char> input) {
+    auto it = ctx.images_by_content.find(key);
+    if (ctx.images_by_content.end() != it) {
+        auto& loaded = it->second;
+        if (loaded.size == input.size() &&
+                (0 == input.size() || 0 == std::memcmp(loaded.data, input.data(), input.size()))) {
+            return loaded.image;
+        }
     }
-    auto span = sl::io::make_span(sink_bin.data(), sink_bin.size());
-    return load_image_from_bytes(doc, span, format);
+    return nullptr;
 }
 
-HPDF_Image load_image_from_file(HPDF_Doc doc, const std::string& image_path, const std::string& format) {
-    // read file
-    auto src = sl::tinydir::file_source(image_path);
-    auto sink = sl::io::make_array_sink();
-    sl::io::copy_all(src, sink);
-    auto span = sl::io::make_span(sink.data(), sink.size());
-    return load_image_from_bytes(doc, span, format);
+// on hash collision the first input is kept and
+// the colliding one is loaded on every call
+void remember_loaded_image(pdf_context& ctx, std::string&& key, HPDF_Image image,
+        std::shared_ptr<const void> owner, sl::io::span<const char> input) {
+    ctx.images_by_content.emplace(std::move(key), loaded_image{image, std::move(owner), input.data(), input.size()});
 }
 
-class rgb_color {
-public:
-    float r = 0;
-    float g = 0;
-    float b = 0;
+// copy of the encoded input, is charged to the document memory
+struct encoded_input {
+    std::string data;
+    memory_reservation reserved;
+};
 
-    rgb_color() { }
+HPDF_Image load_image_from_encoded(pdf_context& ctx, const std::string& encoded, const std::string& encoding,
+        std::vector<char>(*decode)(sl::io::span<const char>), const std::string& format) {
+    auto key = format + ":" + encoding + ":" + content_hash({encoded.data(), encoded.length()});
+    HPDF_Image loaded = find_loaded_image(ctx, key, {encoded.data(), encoded.length()});
+    if (nullptr != loaded) {
+        return loaded;
+    }
+    auto input = std::make_shared<encoded_input>();
+    if (!input->reserved.reserve(encoded.length())) throw memory_limit_exception(TRACEMSG(
+            "Memory limit exceeded loading image," +
+            " bytes required: [" + sl::support::to_string(encoded.length()) + "]"));
+    // convert to binary
+    auto bin = decode({encoded.data(), encoded.length()});
+    auto span = sl::io::make_span(bin.data(), bin.size());
+    HPDF_Image image = load_image_from_bytes(ctx.doc, span, format);
+    input->data = encoded;
+    remember_loaded_image(ctx, std::move(key), image, input, {input->data.data(), input->data.length()});
+    return image;
+}
 
-    rgb_color(const sl::json::value& val) :
-    r(check01(ungarble_float(val["r"], "color.r"))),
-    g(check01(ungarble_float(val["g"], "color.g"))),
-    b(check01(ungarble_float(val["b"], "color.b"))) { }
+// file contents, validation results and decoded PNG are shared between documents
+HPDF_Image load_image_from_file(pdf_context& ctx, const std::string& image_path, const std::string& format) {
+    auto cache = shared_image_cache();
+    auto cache_key = format + ":" + file_fingerprint(image_path);
+    auto cached = cache->get(cache_key);
+    if (nullptr == cached.get()) {
+        cached = read_image_file(image_path, format);
+        // file may have been replaced after 'stat', contents are
+        // cached under the fingerprint of the file they were read from
+        cache->put(format + ":" + cached->fingerprint, cached);
+    }
+    if (!cached->error.empty()) throw support::exception(TRACEMSG(cached->error));
+    auto key = format + ":bin:" + cached->hash;
+    const file_contents& contents = *cached->contents;
+    HPDF_Image loaded = find_loaded_image(ctx, key, contents.data());
+    if (nullptr != loaded) {
+        return loaded;
+    }
+    HPDF_Image image = nullptr != cached->png.get() ? embed_png(ctx.doc, contents.data(), *cached->png) :
+            embed_jpeg(ctx.doc, contents.data());
+    remember_loaded_image(ctx, std::move(key), image, cached, contents.data());
+    return image;
+}
 
-private:
-    static float check01(float val) {
-        if (val < static_cast<float>(0) || val > static_cast<float>(1)) {
-            throw support::exception(TRACEMSG(
-                    "Invalid RGB color element specified," +
-                    " value: [" + sl::support::to_string(val) + "]"));
-        }
-        return val;
+// registered data is validated and decoded once and is embedded in place
+HPDF_Image load_image_from_buffer(pdf_context& ctx, int64_t buffer_id, const std::string& format) {
+    auto buf = buffer_registry()->peek(buffer_id);
+    if (nullptr == buf.get()) throw support::exception(TRACEMSG(
+            "Invalid 'bufferId' parameter specified, value: [" + sl::support::to_string(buffer_id) + "]"));
+    auto key = format + ":bin:" + buf->hash();
+    HPDF_Image loaded = find_loaded_image(ctx, key, buf->data());
+    if (nullptr != loaded) {
+        return loaded;
+    }
+    auto png = std::shared_ptr<const decoded_png>();
+    if ("PNG" == format) {
+        png = buf->check_valid(format, [](sl::io::span<char> span) {
+            return decode_png_shared({span.data(), span.size()});
+        });
+    } else {
+        buf->check_valid(format, [&format](sl::io::span<char> span) {
+            check_image_valid(span, format);
+            return std::shared_ptr<const decoded_png>();
+        });
     }
+    HPDF_Image image = nullptr != png.get() ? embed_png(ctx.doc, buf->data(), *png) :
+            embed_jpeg(ctx.doc, buf->data());
+    remember_loaded_image(ctx, std::move(key), image, buf, buf->data());
+    return image;
+}
+
+HPDF_Page current_page(HPDF_Doc doc) {
+    HPDF_Page page = HPDF_GetCurrentPage(doc);
+    if (nullptr == page) throw support::exception(TRACEMSG(
+            "PDF generation error, cannot access current page," +
+            " please add at least one page to the document first"));
+    return page;
+}
+
+// call arguments, string fields reference the input JSON;
+// op arguments are bound with per-op field enums and schemas, that are
+// shared by standalone calls and batched ops, arguments of primitive
+// calls are parsed in flat_parsers.hpp
+
+struct load_font_args {
+    int64_t handle = -1;
+    std::reference_wrapper<const std::string> path = std::ref(sl::utils::empty_string());
 };
 
-} // namespace
+struct add_page_args {
+    int64_t handle = -1;
+    std::reference_wrapper<const std::string> format = std::ref(sl::utils::empty_string());
+    std::reference_wrapper<const std::string> orient = std::ref(sl::utils::empty_string());
+    int64_t width = -1;
+    int64_t height = -1;
+};
 
-support::buffer create_document(sl::io::span<const char>) {
-    HPDF_Doc doc = HPDF_New([](HPDF_STATUS error_no, HPDF_STATUS detail_no, void*) {
-        throw support::exception(TRACEMSG("PDF generation error: code: [" + sl::support::to_string(error_no) + "]," +
-                " detail: [" + sl::support::to_string(detail_no) + "]"));
-    }, nullptr);
-    if (nullptr == doc) throw support::exception(TRACEMSG("'HPDF_New' error"));
-    HPDF_UseUTFEncodings(doc);
-    HPDF_SetCompressionMode(doc, HPDF_COMP_ALL);
-    HPDF_SetPageMode(doc, HPDF_PAGE_MODE_USE_OUTLINE);
-    auto reg = doc_registry();
-    int64_t handle = reg->put(doc);
-    return support::make_json_buffer({
-        { "pdfDocumentHandle", handle}
-    });
-}
+// image data is taken from exactly one of the inputs
+struct image_source {
+    std::reference_wrapper<const std::string> hex = std::ref(sl::utils::empty_string());
+    std::reference_wrapper<const std::string> base64 = std::ref(sl::utils::empty_string());
+    std::reference_wrapper<const std::string> path = std::ref(sl::utils::empty_string());
+    std::reference_wrapper<const std::string> format = std::ref(sl::utils::empty_string());
+    int64_t buffer_id = -1;
 
-support::buffer load_font(sl::io::span<const char> data) {
-    // json parse
-    auto json = sl::json::load(data);
+    int inputs_count() const {
+        return (hex.get().empty() ? 0 : 1) +
+                (base64.get().empty() ? 0 : 1) +
+                (path.get().empty() ? 0 : 1) +
+                (-1 == buffer_id ? 0 : 1);
+    }
+};
+
+struct draw_image_args {
+    int64_t handle = -1;
+    int32_t x = -1;
+    int32_t y = -1;
+    int32_t width = -1;
+    int32_t height = -1;
+    image_source source;
+    int64_t image_id = -1;
+};
+
+struct load_image_args {
+    int64_t handle = -1;
+    image_source source;
+};
+
+struct save_to_file_args {
+    int64_t handle = -1;
+    std::reference_wrapper<const std::string> path = std::ref(sl::utils::empty_string());
+};
+
+struct save_to_stream_args {
     int64_t handle = -1;
-    auto rpath = std::ref(sl::utils::empty_string());
-    for (const sl::json::field& fi : json.as_object()) {
+    int32_t fd = -1;
+    uint32_t chunk_size = 1 << 16;
+};
+
+enum class load_font_field { handle, ttf_path };
+
+const field_schema& load_font_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "ttfPath", true }
+    };
+    return schema;
+}
+
+load_font_args parse_load_font(const sl::json::value& json, bool handle_required) {
+    auto args = load_font_args();
+    load_font_schema().bind(json, [&args](int id, const sl::json::field& fi) {
         auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else if ("ttfPath" == name) {
-            rpath = fi.as_string_nonempty_or_throw(name);
-        } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+        switch (static_cast<load_font_field>(id)) {
+        case load_font_field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case load_font_field::ttf_path: args.path = fi.as_string_nonempty_or_throw(name); break;
         }
+    }, handle_required ? static_cast<int>(load_font_field::handle) : -1);
+    return args;
+}
+
+// font is parsed once per document for every fingerprint of its file,
+// changed file is parsed again; haru registers it if its base font name
+// is new and returns the font it already has for the same base font name
+sl::json::value apply_load_font(pdf_context& ctx, const load_font_args& args) {
+    const std::string& path = args.path.get();
+    auto fingerprint = file_fingerprint(path);
+    auto stats = shared_font_stats();
+    auto loaded = ctx.fonts_by_fingerprint.find(fingerprint);
+    if (ctx.fonts_by_fingerprint.end() != loaded) {
+        stats->record_reused();
+        return {
+            { "fontName", loaded->second }
+        };
     }
-    if (-1 == handle) throw support::exception(TRACEMSG(
-            "Required parameter 'pdfDocumentHandle' not specified"));
-    if (rpath.get().empty()) throw support::exception(TRACEMSG(
-            "Required parameter 'ttfPath' not specified"));
-    const std::string& path = rpath.get();
-    // get handle
-    auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
-            "Invalid 'pdfDocumentHandle' parameter specified"));
-    auto deferred = sl::support::defer([reg, doc]() STATICLIB_NOEXCEPT {
-        reg->put(doc);
-    });
-    // call haru
-    auto font_name = HPDF_LoadTTFontFromFile(doc, path.c_str(), HPDF_TRUE);
-    return support::make_json_buffer({
+    uint64_t used_before = ctx.memory->used.load(std::memory_order_relaxed);
+    auto font_name = std::string(HPDF_LoadTTFontFromFile(ctx.doc, path.c_str(), HPDF_TRUE));
+    uint64_t used_after = ctx.memory->used.load(std::memory_order_relaxed);
+    ctx.fonts_by_fingerprint.emplace(std::move(fingerprint), font_name);
+    stats->record_parsed(used_after > used_before ? used_after - used_before : 0);
+    return {
         { "fontName", font_name }
-    });
+    };
 }
 
-support::buffer add_page(sl::io::span<const char> data) {
-    // json parse
-    auto json = sl::json::load(data);
-    int64_t handle = -1;
-    auto rformat = std::ref(sl::utils::empty_string());
-    auto rorient = std::ref(sl::utils::empty_string());
-    int64_t width = -1;
-    int64_t height = -1;
-    for (const sl::json::field& fi : json.as_object()) {
+enum class add_page_field { handle, format, orientation, width, height };
+
+// either 'format' and 'orientation' or 'width' and 'height' are checked by parser
+const field_schema& add_page_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "format", false },
+        { "orientation", false },
+        { "width", false },
+        { "height", false }
+    };
+    return schema;
+}
+
+add_page_args parse_add_page(const sl::json::value& json, bool handle_required) {
+    auto args = add_page_args();
+    add_page_schema().bind(json, [&args](int id, const sl::json::field& fi) {
         auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else if ("format" == name) {
-            rformat = fi.as_string_nonempty_or_throw(name);
-        } else if ("orientation" == name) {
-            rorient = fi.as_string_nonempty_or_throw(name);
-        } else if ("width" == name) {
-            width = fi.as_int64_or_throw(name);
-        } else if ("height" == name) {
-            height = fi.as_int64_or_throw(name);
-        } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+        switch (static_cast<add_page_field>(id)) {
+        case add_page_field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case add_page_field::format: args.format = fi.as_string_nonempty_or_throw(name); break;
+        case add_page_field::orientation: args.orient = fi.as_string_nonempty_or_throw(name); break;
+        case add_page_field::width: args.width = fi.as_int64_or_throw(name); break;
+        case add_page_field::height: args.height = fi.as_int64_or_throw(name); break;
         }
-    }
-    if (-1 == handle) throw support::exception(TRACEMSG(
-            "Required parameter 'pdfDocumentHandle' not specified"));
-    if (rformat.get().empty() && !(-1 != height && -1 != width)) throw support::exception(TRACEMSG(
+    }, handle_required ? static_cast<int>(add_page_field::handle) : -1);
+    const std::string& format = args.format.get();
+    const std::string& orient = args.orient.get();
+    if (format.empty() && !(-1 != args.height && -1 != args.width)) throw support::exception(TRACEMSG(
             "Required parameter 'format' not specified"));
-    if (rorient.get().empty() && !(-1 != height && -1 != width)) throw support::exception(TRACEMSG(
+    if (orient.empty() && !(-1 != args.height && -1 != args.width)) throw support::exception(TRACEMSG(
             "Required parameter 'orientation' not specified"));
-    if (-1 == width && !(!rformat.get().empty() && ! rorient.get().empty())) throw support::exception(TRACEMSG(
+    if (-1 == args.width && !(!format.empty() && !orient.empty())) throw support::exception(TRACEMSG(
             "Required parameter 'width' not specified"));
-    if (-1 == height && !(!rformat.get().empty() && ! rorient.get().empty())) throw support::exception(TRACEMSG(
+    if (-1 == args.height && !(!format.empty() && !orient.empty())) throw support::exception(TRACEMSG(
             "Required parameter 'height' not specified"));
-    if ((!rformat.get().empty() || !rorient.get().empty()) && (-1 != height || -1 != width)) {
+    if ((!format.empty() || !orient.empty()) && (-1 != args.height || -1 != args.width)) {
         throw support::exception(TRACEMSG("Invalid parameters, either both 'height' and 'width'," +
                 " or both 'format' and 'orientation' must be specified"));
     }
-    const std::string& format = rformat.get();
-    const std::string& orient = rorient.get();
-    // get handle
-    auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
-            "Invalid 'pdfDocumentHandle' parameter specified"));
-    auto deferred = sl::support::defer([reg, doc]() STATICLIB_NOEXCEPT {
-        reg->put(doc);
-    });
+    return args;
+}
+
+HPDF_PageSizes page_size_from_string(const std::string& format) {
+    if (2 == format.length()) {
+        switch (format[0]) {
+        case 'A':
+            switch (format[1]) {
+            case '3': return HPDF_PAGE_SIZE_A3;
+            case '4': return HPDF_PAGE_SIZE_A4;
+            case '5': return HPDF_PAGE_SIZE_A5;
+            }
+            break;
+        case 'B':
+            switch (format[1]) {
+            case '4': return HPDF_PAGE_SIZE_B4;
+            case '5': return HPDF_PAGE_SIZE_B5;
+            }
+            break;
+        }
+    }
+    throw support::exception(TRACEMSG("Unsupported PDF page format specified, format: [" + format + "]"));
+}
+
+HPDF_PageDirection page_direction_from_string(const std::string& orient) {
+    switch (orient.length()) {
+    case 8: if ("PORTRAIT" == orient) return HPDF_PAGE_PORTRAIT; break;
+    case 9: if ("LANDSCAPE" == orient) return HPDF_PAGE_LANDSCAPE; break;
+    }
+    throw support::exception(TRACEMSG("Unsupported PDF page orientation specified, orientation: [" + orient + "]"));
+}
+
+sl::json::value apply_add_page(pdf_context& ctx, const add_page_args& args) {
+    const std::string& format = args.format.get();
+    const std::string& orient = args.orient.get();
     if (!format.empty()) {
-        // call haru
-        HPDF_PageSizes hformat = [&format] () -> HPDF_PageSizes {
-           if ("A3" == format) {
-               return HPDF_PAGE_SIZE_A3;
-           } else if ("A4" == format) {
-               return HPDF_PAGE_SIZE_A4;
-           } else if ("A5" == format) {
-               return HPDF_PAGE_SIZE_A5;
-           } else if ("B4" == format) {
-               return HPDF_PAGE_SIZE_B4;
-           } else if ("B5" == format) {
-               return HPDF_PAGE_SIZE_B5;
-           } else throw support::exception(TRACEMSG("Unsupported PDF page format specified, format: [" + format + "]"));
-        } ();
-        HPDF_PageDirection horient = [&orient] () -> HPDF_PageDirection {
-           if ("PORTRAIT" == orient) {
-               return HPDF_PAGE_PORTRAIT;
-           } else if ("LANDSCAPE" == orient) {
-               return HPDF_PAGE_LANDSCAPE;
-           } else throw support::exception(TRACEMSG("Unsupported PDF page orientation specified, orientation: [" + orient + "]"));
-        } ();
-        HPDF_Page page = HPDF_AddPage(doc);
+        HPDF_PageSizes hformat = page_size_from_string(format);
+        HPDF_PageDirection horient = page_direction_from_string(orient);
+        HPDF_Page page = HPDF_AddPage(ctx.doc);
         if (nullptr == page) throw support::exception(TRACEMSG("'HPDF_AddPage' error"));
         HPDF_Page_SetSize(page, hformat, horient);
     } else {
-        HPDF_Page page = HPDF_AddPage(doc);
+        HPDF_Page page = HPDF_AddPage(ctx.doc);
         if (nullptr == page) throw support::exception(TRACEMSG("'HPDF_AddPage' error"));
-        HPDF_Page_SetWidth(page, static_cast<float>(width));
-        HPDF_Page_SetHeight(page, static_cast<float>(height));
+        HPDF_Page_SetWidth(page, static_cast<float>(args.width));
+        HPDF_Page_SetHeight(page, static_cast<float>(args.height));
     }
-    return support::make_null_buffer();
+    return sl::json::value();
 }
 
-support::buffer write_text(sl::io::span<const char> data) {
-    // json parse
-    auto json = sl::json::load(data);
-    int64_t handle = -1;
-    auto rfont_name = std::ref(sl::utils::empty_string());
-    float font_size = -1;
-    auto rtext = std::ref(sl::utils::empty_string());
-    int32_t x = -1;
-    int32_t y = -1;
-    auto color = rgb_color();
-    for (const sl::json::field& fi : json.as_object()) {
+// font aliases are only set for rendered documents
+const std::string& resolve_font_name(const pdf_context& ctx, const std::string& name) {
+    if (ctx.font_aliases.empty()) {
+        return name;
+    }
+    auto it = ctx.font_aliases.find(name);
+    return ctx.font_aliases.end() != it ? it->second : name;
+}
+
+sl::json::value apply_write_text(pdf_context& ctx, const write_text_args& args) {
+    const std::string& font_name = resolve_font_name(ctx, args.font_name);
+    const std::string& text = args.text;
+    HPDF_Page page = current_page(ctx.doc);
+    HPDF_Page_SetRGBFill(page, args.color.r, args.color.g, args.color.b);
+    auto font = HPDF_GetFont(ctx.doc, font_name.c_str(), "UTF-8");
+    HPDF_Page_SetFontAndSize(page, font, args.font_size);
+    HPDF_Page_BeginText(page);
+    HPDF_Page_TextOut(page, static_cast<float>(args.x), static_cast<float>(args.y), text.c_str());
+    HPDF_Page_EndText(page);
+    return sl::json::value();
+}
+
+HPDF_TextAlignment text_alignment_from_string(const std::string& align) {
+    switch (align.length()) {
+    case 4: if ("LEFT" == align) return HPDF_TALIGN_LEFT; break;
+    case 5: if ("RIGHT" == align) return HPDF_TALIGN_RIGHT; break;
+    case 6: if ("CENTER" == align) return HPDF_TALIGN_CENTER; break;
+    case 7: if ("JUSTIFY" == align) return HPDF_TALIGN_JUSTIFY; break;
+    }
+    throw support::exception(TRACEMSG(
+            "Invalid 'align' parameter specified, value: [" + align + "]"));
+}
+
+sl::json::value apply_write_text_inside_rectangle(pdf_context& ctx, const write_text_inside_rectangle_args& args) {
+    const std::string& font_name = resolve_font_name(ctx, args.font_name);
+    const std::string& text = args.text;
+    const std::string& align = args.align;
+    HPDF_TextAlignment halign = text_alignment_from_string(align);
+    HPDF_Page page = current_page(ctx.doc);
+    HPDF_Page_SetRGBFill(page, args.color.r, args.color.g, args.color.b);
+    auto font = HPDF_GetFont(ctx.doc, font_name.c_str(), "UTF-8");
+    HPDF_Page_SetFontAndSize(page, font, args.font_size);
+    HPDF_Page_BeginText(page);
+    HPDF_Page_TextRect(page, static_cast<float>(args.left), static_cast<float>(args.top),
+            static_cast<float>(args.right), static_cast<float>(args.bottom), text.c_str(), halign, nullptr);
+    HPDF_Page_EndText(page);
+    return sl::json::value();
+}
+
+sl::json::value apply_draw_line(pdf_context& ctx, const draw_line_args& args) {
+    HPDF_Page page = current_page(ctx.doc);
+    HPDF_Page_SetRGBStroke(page, args.color.r, args.color.g, args.color.b);
+    HPDF_Page_SetLineWidth(page, args.lineWidth);
+    HPDF_Page_MoveTo(page, static_cast<float>(args.beginX), static_cast<float>(args.beginY));
+    HPDF_Page_LineTo(page, static_cast<float>(args.endX), static_cast<float>(args.endY));
+    HPDF_Page_Stroke(page);
+    return sl::json::value();
+}
+
+sl::json::value apply_draw_rectangle(pdf_context& ctx, const draw_rectangle_args& args) {
+    HPDF_Page page = current_page(ctx.doc);
+    HPDF_Page_SetRGBStroke(page, args.color.r, args.color.g, args.color.b);
+    HPDF_Page_SetLineWidth(page, args.lineWidth);
+    HPDF_Page_Rectangle(page, static_cast<float>(args.x), static_cast<float>(args.y),
+            static_cast<float>(args.width), static_cast<float>(args.height));
+    HPDF_Page_Stroke(page);
+    return sl::json::value();
+}
+
+void check_image_format(const std::string& format) {
+    if (format.empty()) throw support::exception(TRACEMSG(
+            "Required parameter 'imageFormat' not specified"));
+    // check that input is PNG or JPEG
+    if ("PNG" != format && "JPEG" != format) throw support::exception(TRACEMSG(
+            "Invalid 'imageFormat' specified: [" + format + "], supported formats: [PNG, JPEG]"));
+}
+
+HPDF_Image load_image_from_source(pdf_context& ctx, const image_source& source) {
+    const std::string& format = source.format.get();
+    if (!source.hex.get().empty()) {
+        return load_image_from_encoded(ctx, source.hex.get(), "hex", decode_hex, format);
+    } else if (!source.base64.get().empty()) {
+        return load_image_from_encoded(ctx, source.base64.get(), "b64", decode_base64, format);
+    } else if (-1 != source.buffer_id) {
+        return load_image_from_buffer(ctx, source.buffer_id, format);
+    } else {
+        return load_image_from_file(ctx, source.path.get(), format);
+    }
+}
+
+enum class load_image_field { handle, image_hex, image_base64, image_path, buffer_id, image_format };
+
+// image source and format are checked by parser
+const field_schema& load_image_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "imageHex", false },
+        { "imageBase64", false },
+        { "imagePath", false },
+        { "bufferId", false },
+        { "imageFormat", false }
+    };
+    return schema;
+}
+
+load_image_args parse_load_image(const sl::json::value& json, bool handle_required) {
+    using field = load_image_field;
+    auto args = load_image_args();
+    load_image_schema().bind(json, [&args](int id, const sl::json::field& fi) {
         auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else if ("fontName" == name) {
-            rfont_name = fi.as_string_nonempty_or_throw(name);
-        } else if ("fontSize" == name) {
-            font_size = ungarble_float(fi.val(), name);
-        } else if ("text" == name) {
-            rtext = fi.as_string_nonempty_or_throw(name);
-        } else if ("x" == name) {
-            x = fi.as_uint16_or_throw(name);
-        } else if ("y" == name) {
-            y = fi.as_uint16_or_throw(name);
-        } else if ("color" == name) {
-            color = rgb_color(fi.val());
-        } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+        switch (static_cast<field>(id)) {
+        case field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case field::image_hex: args.source.hex = fi.as_string_nonempty_or_throw(name); break;
+        case field::image_base64: args.source.base64 = fi.as_string_nonempty_or_throw(name); break;
+        case field::image_path: args.source.path = fi.as_string_nonempty_or_throw(name); break;
+        case field::buffer_id: args.source.buffer_id = fi.as_int64_or_throw(name); break;
+        case field::image_format: args.source.format = fi.as_string_nonempty_or_throw(name); break;
         }
+    }, handle_required ? static_cast<int>(field::handle) : -1);
+    // same order as in 'draw_image'
+    if (args.source.format.get().empty()) throw support::exception(TRACEMSG(
+            "Required parameter 'imageFormat' not specified"));
+    if (1 != args.source.inputs_count()) throw support::exception(TRACEMSG(
+            "Either 'imageHex', 'imageBase64', 'imagePath' or 'bufferId' must be specified"));
+    check_image_format(args.source.format.get());
+    return args;
+}
+
+sl::json::value apply_load_image(pdf_context& ctx, const load_image_args& args) {
+    HPDF_Image image = load_image_from_source(ctx, args.source);
+    ctx.images.push_back(image);
+    return {
+        { "imageId", static_cast<int64_t>(ctx.images.size() - 1) }
+    };
+}
+
+enum class draw_image_field {
+    handle, x, y, width, height, image_hex, image_base64, image_path, buffer_id, image_format, image_id
+};
+
+// image source and format are checked by parser
+const field_schema& draw_image_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "x", true },
+        { "y", true },
+        { "width", true },
+        { "height", true },
+        { "imageHex", false },
+        { "imageBase64", false },
+        { "imagePath", false },
+        { "bufferId", false },
+        { "imageFormat", false },
+        { "imageId", false }
+    };
+    return schema;
+}
+
+draw_image_args parse_draw_image(const sl::json::value& json, bool handle_required) {
+    using field = draw_image_field;
+    auto args = draw_image_args();
+    draw_image_schema().bind(json, [&args](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (static_cast<field>(id)) {
+        case field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case field::x: args.x = fi.as_uint16_or_throw(name); break;
+        case field::y: args.y = fi.as_uint16_or_throw(name); break;
+        case field::width: args.width = fi.as_uint16_or_throw(name); break;
+        case field::height: args.height = fi.as_uint16_or_throw(name); break;
+        case field::image_hex: args.source.hex = fi.as_string_nonempty_or_throw(name); break;
+        case field::image_base64: args.source.base64 = fi.as_string_nonempty_or_throw(name); break;
+        case field::image_path: args.source.path = fi.as_string_nonempty_or_throw(name); break;
+        case field::buffer_id: args.source.buffer_id = fi.as_int64_or_throw(name); break;
+        case field::image_format: args.source.format = fi.as_string_nonempty_or_throw(name); break;
+        case field::image_id: args.image_id = fi.as_int64_or_throw(name); break;
+        }
+    }, handle_required ? static_cast<int>(field::handle) : -1);
+    // missing format is reported before the source, invalid one - after it
+    if (-1 == args.image_id && args.source.format.get().empty()) throw support::exception(TRACEMSG(
+            "Required parameter 'imageFormat' not specified"));
+    int sources = args.source.inputs_count() + (-1 == args.image_id ? 0 : 1);
+    if (1 != sources) throw support::exception(TRACEMSG(
+            "Either 'imageHex', 'imageBase64', 'imagePath', 'bufferId' or 'imageId' must be specified"));
+    if (-1 == args.image_id) {
+        check_image_format(args.source.format.get());
     }
-    if (-1 == handle) throw support::exception(TRACEMSG(
+    return args;
+}
+
+sl::json::value apply_draw_image(pdf_context& ctx, const draw_image_args& args) {
+    HPDF_Page page = current_page(ctx.doc);
+    HPDF_Image image = nullptr;
+    if (-1 != args.image_id) {
+        if (args.image_id < 0 || static_cast<size_t>(args.image_id) >= ctx.images.size()) {
+            throw support::exception(TRACEMSG(
+                    "Invalid 'imageId' parameter specified, value: [" + sl::support::to_string(args.image_id) + "]"));
+        }
+        image = ctx.images.at(static_cast<size_t>(args.image_id));
+    } else {
+        image = load_image_from_source(ctx, args.source);
+    }
+    HPDF_Page_DrawImage(page, image, static_cast<HPDF_REAL>(args.x), static_cast<HPDF_REAL>(args.y),
+            static_cast<HPDF_REAL>(args.width), static_cast<HPDF_REAL>(args.height));
+    return sl::json::value();
+}
+
+enum class save_to_file_field { handle, path };
+
+const field_schema& save_to_file_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "path", true }
+    };
+    return schema;
+}
+
+save_to_file_args parse_save_to_file(const sl::json::value& json, bool handle_required) {
+    auto args = save_to_file_args();
+    save_to_file_schema().bind(json, [&args](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (static_cast<save_to_file_field>(id)) {
+        case save_to_file_field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case save_to_file_field::path: args.path = fi.as_string_nonempty_or_throw(name); break;
+        }
+    }, handle_required ? static_cast<int>(save_to_file_field::handle) : -1);
+    return args;
+}
+
+sl::json::value apply_save_to_file(pdf_context& ctx, const save_to_file_args& args) {
+    const std::string& path = args.path.get();
+    // serialization is done by haru together with writing
+    phase_scope phase(call_phase::io);
+    HPDF_SaveToFile(ctx.doc, path.c_str());
+    uint64_t size = 0;
+    file_fingerprint(path, std::addressof(size));
+    shared_counters()->bytes_saved.fetch_add(size, std::memory_order_relaxed);
+    return sl::json::value();
+}
+
+enum class save_to_stream_field { handle, fd, chunk_size };
+
+// files are written directly by 'save_to_file'
+const field_schema& save_to_stream_schema() {
+    static const field_schema schema{
+        { "pdfDocumentHandle", false },
+        { "fd", true },
+        { "chunkSize", false }
+    };
+    return schema;
+}
+
+save_to_stream_args parse_save_to_stream(const sl::json::value& json, bool handle_required) {
+    auto args = save_to_stream_args();
+    save_to_stream_schema().bind(json, [&args](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (static_cast<save_to_stream_field>(id)) {
+        case save_to_stream_field::handle: args.handle = fi.as_int64_or_throw(name); break;
+        case save_to_stream_field::fd: args.fd = fi.as_int32_or_throw(name); break;
+        case save_to_stream_field::chunk_size: args.chunk_size = fi.as_uint32_or_throw(name); break;
+        }
+    }, handle_required ? static_cast<int>(save_to_stream_field::handle) : -1);
+    if (args.fd < 0) throw support::exception(TRACEMSG(
+            "Invalid 'fd' parameter specified, value: [" + sl::support::to_string(args.fd) + "]"));
+    // chunk buffer is allocated in full before streaming starts
+    if (args.chunk_size < 1024 || args.chunk_size > (1 << 24)) throw support::exception(TRACEMSG(
+            "Invalid 'chunkSize' parameter specified, minimum value: [1024]," +
+            " maximum value: [16777216]," +
+            " value: [" + sl::support::to_string(args.chunk_size) + "]"));
+    return args;
+}
+
+sl::json::value apply_save_to_stream(pdf_context& ctx, const save_to_stream_args& args) {
+    int fd = args.fd;
+    uint64_t written = save_to_sink(ctx.doc, args.chunk_size, [fd](sl::io::span<const char> chunk) {
+        phase_scope phase(call_phase::io);
+        write_to_fd(fd, chunk);
+    });
+    shared_counters()->bytes_saved.fetch_add(written, std::memory_order_relaxed);
+    return {
+        { "bytesWritten", static_cast<int64_t>(written) }
+    };
+}
+
+// parses the input, waits for the document to become
+// available and applies the call to it
+template<typename Args>
+support::buffer run_with_args(const Args& args, sl::json::value(*apply)(pdf_context&, const Args&)) {
+    if (-1 == args.handle) throw support::exception(TRACEMSG(
             "Required parameter 'pdfDocumentHandle' not specified"));
-    if (rfont_name.get().empty()) throw support::exception(TRACEMSG(
-            "Required parameter 'fontName' not specified"));
-    if (font_size < 0) throw support::exception(TRACEMSG(
-            "Required parameter 'fontSize' not specified"));
-    if (-1 == x) throw support::exception(TRACEMSG(
-            "Required parameter 'x' not specified"));
-    if (-1 == y) throw support::exception(TRACEMSG(
-            "Required parameter 'y' not specified"));
-    if (rtext.get().empty()) throw support::exception(TRACEMSG(
-            "Required parameter 'text' not specified"));
-    const std::string& font_name = rfont_name.get();
-    const std::string& text = rtext.get();
     // get handle
-    auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
-            "Invalid 'pdfDocumentHandle' parameter specified"));
-    auto deferred = sl::support::defer([reg, doc]() STATICLIB_NOEXCEPT {
-        reg->put(doc);
-    });
+    auto pdoc = find_document(args.handle);
     // call haru
-    HPDF_Page page = HPDF_GetCurrentPage(doc);
-    if (nullptr == page) throw support::exception(TRACEMSG(
-            "PDF generation error, cannot access current page," +
-            " please add at least one page to the document first"));
-    HPDF_Page_SetRGBFill(page, color.r, color.g, color.b);
-    auto font = HPDF_GetFont(doc, font_name.c_str(), "UTF-8");
-    HPDF_Page_SetFontAndSize(page, font, font_size);
-    HPDF_Page_BeginText(page);
-    HPDF_Page_TextOut(page, static_cast<float>(x), static_cast<float>(y), text.c_str());
-    HPDF_Page_EndText(page);
-    return support::make_null_buffer();
+    auto res = pdoc->execute([&args, apply](pdf_context& ctx) {
+        return apply(ctx, args);
+    });
+    if (sl::json::type::nullt == res.json_type()) {
+        return support::make_null_buffer();
+    }
+    return support::make_json_buffer(res);
 }
 
-support::buffer write_text_inside_rectangle(sl::io::span<const char> data) {
+template<typename Args>
+support::buffer run_with_document(sl::io::span<const char> data,
+        Args(*parse)(const sl::json::value&, bool),
+        sl::json::value(*apply)(pdf_context&, const Args&)) {
     // json parse
-    auto json = sl::json::load(data);
-    int64_t handle = -1;
-    auto rfont_name = std::ref(sl::utils::empty_string());
-    float font_size = -1;
-    auto rtext = std::ref(sl::utils::empty_string());
-    int32_t left = -1;
-    int32_t top = -1;
-    int32_t right = -1;
-    int32_t bottom = -1;
-    auto ralign = std::ref(sl::utils::empty_string());
-    auto color = rgb_color();
-    for (const sl::json::field& fi : json.as_object()) {
+    auto json = load_json(data);
+    auto args = [&json, parse] {
+        phase_scope phase(call_phase::parse);
+        // handle error is reported before errors of other required fields
+        return parse(json, true);
+    } ();
+    return run_with_args(args, apply);
+}
+
+// primitive calls read their input without building JSON tree,
+// unsupported or invalid input is parsed again to report the error
+template<typename Args>
+support::buffer run_with_document_flat(sl::io::span<const char> data,
+        bool(*parse_flat)(sl::io::span<const char>, Args&),
+        Args(*parse)(const sl::json::value&, bool),
+        sl::json::value(*apply)(pdf_context&, const Args&)) {
+    auto args = Args();
+    bool parsed = [data, parse_flat, &args] {
+        phase_scope phase(call_phase::parse);
+        return parse_flat(data, args);
+    } ();
+    if (!parsed) {
+        return run_with_document(data, parse, apply);
+    }
+    return run_with_args(args, apply);
+}
+
+// batched ops are applied to the document that is already acquired
+template<typename Args>
+sl::json::value run_batched(pdf_context& ctx, const sl::json::value& json,
+        Args(*parse)(const sl::json::value&, bool),
+        sl::json::value(*apply)(pdf_context&, const Args&)) {
+    auto args = [&json, parse] {
+        phase_scope phase(call_phase::parse);
+        return parse(json, false);
+    } ();
+    if (-1 != args.handle) throw support::exception(TRACEMSG(
+            "Parameter 'pdfDocumentHandle' must not be specified for batched op"));
+    return apply(ctx, args);
+}
+
+sl::json::value dispatch_batched_op(pdf_context& ctx, const std::string& op, const sl::json::value& args) {
+    if ("load_font" == op) {
+        return run_batched(ctx, args, parse_load_font, apply_load_font);
+    } else if ("add_page" == op) {
+        return run_batched(ctx, args, parse_add_page, apply_add_page);
+    } else if ("write_text" == op) {
+        return run_batched(ctx, args, parse_write_text, apply_write_text);
+    } else if ("write_text_inside_rectangle" == op) {
+        return run_batched(ctx, args, parse_write_text_inside_rectangle, apply_write_text_inside_rectangle);
+    } else if ("draw_line" == op) {
+        return run_batched(ctx, args, parse_draw_line, apply_draw_line);
+    } else if ("draw_rectangle" == op) {
+        return run_batched(ctx, args, parse_draw_rectangle, apply_draw_rectangle);
+    } else if ("load_image" == op) {
+        return run_batched(ctx, args, parse_load_image, apply_load_image);
+    } else if ("draw_image" == op) {
+        return run_batched(ctx, args, parse_draw_image, apply_draw_image);
+    } else if ("save_to_file" == op) {
+        return run_batched(ctx, args, parse_save_to_file, apply_save_to_file);
+    } else throw support::exception(TRACEMSG("Unsupported batched op specified: [" + op + "]"));
+}
+
+// rendered pages only draw, ops results are not returned to caller,
+// fonts are loaded before the pages and pages are added from their sizes
+sl::json::value dispatch_render_op(pdf_context& ctx, const std::string& op, const sl::json::value& args) {
+    if ("write_text" == op) {
+        return run_batched(ctx, args, parse_write_text, apply_write_text);
+    } else if ("write_text_inside_rectangle" == op) {
+        return run_batched(ctx, args, parse_write_text_inside_rectangle, apply_write_text_inside_rectangle);
+    } else if ("draw_line" == op) {
+        return run_batched(ctx, args, parse_draw_line, apply_draw_line);
+    } else if ("draw_rectangle" == op) {
+        return run_batched(ctx, args, parse_draw_rectangle, apply_draw_rectangle);
+    } else if ("draw_image" == op) {
+        return run_batched(ctx, args, parse_draw_image, apply_draw_image);
+    } else throw support::exception(TRACEMSG("Unsupported op for render_document: [" + op + "]"));
+}
+
+// op entry: {"op": "write_text", "args": {...}}
+sl::json::value execute_batched_op(pdf_context& ctx, const sl::json::value& op_json,
+        sl::json::value(*dispatch)(pdf_context&, const std::string&, const sl::json::value&) = dispatch_batched_op) {
+    enum { f_op, f_args };
+    static const field_schema schema{
+        { "op", true },
+        { "args", false }
+    };
+    static const sl::json::value empty_args = sl::json::value(std::vector<sl::json::field>());
+    auto rop = std::ref(sl::utils::empty_string());
+    const sl::json::value* args = std::addressof(empty_args);
+    op_json.as_object_or_throw("ops");
+    schema.bind(op_json, [&rop, &args](int id, const sl::json::field& fi) {
         auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else if ("fontName" == name) {
-            rfont_name = fi.as_string_nonempty_or_throw(name);
-        } else if ("fontSize" == name) {
-            font_size = ungarble_float(fi.val(), name);
-        } else if ("text" == name) {
-            rtext = fi.as_string_nonempty_or_throw(name);
-        } else if ("left" == name) {
-            left = fi.as_uint16_or_throw(name);
-        } else if ("top" == name) {
-            top = fi.as_uint16_or_throw(name);
-        } else if ("right" == name) {
-            right = fi.as_uint16_or_throw(name);
-        } else if ("bottom" == name) {
-            bottom = fi.as_uint16_or_throw(name);
-        } else if ("align" == name) {
-            ralign = fi.as_string_nonempty_or_throw(name);
-        } else if ("color" == name) {
-            color = rgb_color(fi.val());
+        switch (id) {
+        case f_op: rop = fi.as_string_nonempty_or_throw(name); break;
+        case f_args: fi.as_object_or_throw(name); args = std::addressof(fi.val()); break;
+        }
+    });
+    return dispatch(ctx, rop.get(), *args);
+}
+
+// haru allocates document objects from the blocks of this size,
+// individual frees are no-ops, all blocks are freed together with
+// the document, so memory freed by haru (i.e. by repeated saves)
+// is not reused; zero (default) disables pooling
+std::atomic<uint32_t>& mem_pool_block_size() {
+    static std::atomic<uint32_t> size(0);
+    return size;
+}
+
+std::unique_ptr<pdf_context> new_document() {
+    auto memory = std::make_shared<memory_account>();
+    memory_scope scope(memory.get());
+    phase_scope phase(call_phase::haru);
+    auto block_size = mem_pool_block_size().load(std::memory_order_relaxed);
+    HPDF_Doc doc = HPDF_NewEx([](HPDF_STATUS error_no, HPDF_STATUS detail_no, void*) {
+        auto account = current_memory_account();
+        auto msg = std::string();
+        if (nullptr != account && account->limit_exceeded.exchange(false, std::memory_order_relaxed)) {
+            msg = TRACEMSG("PDF memory limit exceeded," +
+                    " document usage: [" + sl::support::to_string(account->used.load(std::memory_order_relaxed)) + "]," +
+                    " total usage: [" + sl::support::to_string(memory_limits::total_used().load(std::memory_order_relaxed)) + "]");
         } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+            msg = TRACEMSG("PDF generation error: code: [" + sl::support::to_string(error_no) + "]," +
+                    " detail: [" + sl::support::to_string(detail_no) + "]");
+        }
+        auto captured = haru_error_capture::current();
+        if (nullptr != captured) {
+            // first error is the cause, haru returns error status
+            if (captured->empty()) {
+                *captured = msg;
+            }
+            return;
         }
+        throw support::exception(msg);
+    }, accounted_alloc, accounted_free, static_cast<HPDF_UINT>(block_size), nullptr);
+    if (nullptr == doc) throw support::exception(TRACEMSG("'HPDF_NewEx' error"));
+    auto ctx = sl::support::make_unique<pdf_context>(doc, std::move(memory));
+    HPDF_UseUTFEncodings(ctx->doc);
+    HPDF_SetCompressionMode(ctx->doc, HPDF_COMP_ALL);
+    HPDF_SetPageMode(ctx->doc, HPDF_PAGE_MODE_USE_OUTLINE);
+    return ctx;
+}
+
+support::buffer save_to_memory(HPDF_Doc doc) {
+    // haru keeps its copy of the output until the next save or until
+    // the document is freed, public API has no call to release it earlier
+    HPDF_SaveToStream(doc);
+    HPDF_ResetStream(doc);
+    // reading exactly the stream size, haru reports EOF as an error
+    HPDF_UINT32 size = HPDF_GetStreamSize(doc);
+    if (0 == size) throw support::exception(TRACEMSG("'HPDF_SaveToStream' error, empty output"));
+    // wilton buffers are limited to int size
+    if (size > static_cast<HPDF_UINT32>(INT_MAX)) throw support::exception(TRACEMSG(
+            "Output document is too large, size: [" + sl::support::to_string(size) + "]," +
+            " max size: [" + sl::support::to_string(INT_MAX) + "]"));
+    // read directly into the result buffer
+    char* buf = wilton_alloc(static_cast<int>(size));
+    if (nullptr == buf) throw support::exception(TRACEMSG(
+            "Error allocating output buffer, size: [" + sl::support::to_string(size) + "]"));
+    try {
+        HPDF_ReadFromStream(doc, reinterpret_cast<HPDF_BYTE*>(buf), std::addressof(size));
+    } catch (...) {
+        wilton_free(buf);
+        throw;
     }
-    if (-1 == handle) throw support::exception(TRACEMSG(
-            "Required parameter 'pdfDocumentHandle' not specified"));
-    if (rfont_name.get().empty()) throw support::exception(TRACEMSG(
-            "Required parameter 'fontName' not specified"));
-    if (font_size < 0) throw support::exception(TRACEMSG(
-            "Required parameter 'fontSize' not specified"));
-    if (-1 == left) throw support::exception(TRACEMSG(
-            "Required parameter 'left' not specified"));
-    if (-1 == top) throw support::exception(TRACEMSG(
-            "Required parameter 'top' not specified"));
-    if (-1 == right) throw support::exception(TRACEMSG(
-            "Required parameter 'right' not specified"));
-    if (-1 == bottom) throw support::exception(TRACEMSG(
-            "Required parameter 'bottom' not specified"));
-    if (rtext.get().empty()) throw support::exception(TRACEMSG(
-            "Required parameter 'text' not specified"));
-    if (ralign.get().empty()) throw support::exception(TRACEMSG(
-            "Required parameter 'align' not specified"));
-    const std::string& font_name = rfont_name.get();
-    const std::string& text = rtext.get();
-    const std::string& align = ralign.get();
-    // get handle
-    auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
-            "Invalid 'pdfDocumentHandle' parameter specified"));
-    auto deferred = sl::support::defer([reg, doc]() STATICLIB_NOEXCEPT {
-        reg->put(doc);
-    });
-    // call haru
-    HPDF_TextAlignment halign = [&align]() -> HPDF_TextAlignment {
-        if ("LEFT" == align) {
-            return HPDF_TALIGN_LEFT;
-        } else if ("RIGHT" == align) {
-            return HPDF_TALIGN_RIGHT;
-        } else if ("CENTER" == align) {
-            return HPDF_TALIGN_CENTER;
-        } else if ("JUSTIFY" == align) {
-            return HPDF_TALIGN_JUSTIFY;
-        } else throw support::exception(TRACEMSG(
-                "Invalid 'align' parameter specified, value: [" + align + "]"));
+    shared_counters()->bytes_saved.fetch_add(size, std::memory_order_relaxed);
+    return support::wrap_wilton_buffer(buf, static_cast<int>(size));
+}
+
+// initialized from wilton_module_init
+std::shared_ptr<pool_refiller> shared_refiller() {
+    static auto refiller = std::make_shared<pool_refiller>();
+    return refiller;
+}
+
+// initialized from wilton_module_init
+std::shared_ptr<document_pool> doc_pool() {
+    static auto pool = [] {
+        auto res = std::make_shared<document_pool>(shared_refiller());
+        shared_refiller()->add(res);
+        return res;
     } ();
-    HPDF_Page page = HPDF_GetCurrentPage(doc);
-    if (nullptr == page) throw support::exception(TRACEMSG(
-            "PDF generation error, cannot access current page," +
-            " please add at least one page to the document first"));
-    HPDF_Page_SetRGBFill(page, color.r, color.g, color.b);
-    auto font = HPDF_GetFont(doc, font_name.c_str(), "UTF-8");
-    HPDF_Page_SetFontAndSize(page, font, font_size);
-    HPDF_Page_BeginText(page);
-    HPDF_Page_TextRect(page, static_cast<float>(left), static_cast<float>(top), static_cast<float>(right), static_cast<float>(bottom), text.c_str(), halign, nullptr);
-    HPDF_Page_EndText(page);
-    return support::make_null_buffer();
+    return pool;
 }
 
-support::buffer draw_line(sl::io::span<const char> data) {
+std::unique_ptr<pdf_context> new_document_with_fonts(const std::vector<std::string>& fonts) {
+    auto ctx = new_document();
+    memory_scope scope(ctx->memory.get());
+    for (auto& path : fonts) {
+        auto args = load_font_args();
+        args.path = std::ref(path);
+        apply_load_font(*ctx, args);
+    }
+    return ctx;
+}
+
+// initialized from wilton_module_init
+std::shared_ptr<sharded_handle_registry<pdf_template>> template_registry() {
+    static auto registry = std::make_shared<sharded_handle_registry<pdf_template>>();
+    return registry;
+}
+
+std::unique_ptr<pdf_context> new_document_from_ops(const sl::json::value& ops,
+        std::vector<sl::json::value>* results) {
+    auto ctx = new_document();
+    memory_scope scope(ctx->memory.get());
+    auto& ops_list = ops.as_array();
+    for (size_t i = 0; i < ops_list.size(); i++) {
+        try {
+            auto res = execute_batched_op(*ctx, ops_list.at(i));
+            if (nullptr != results) {
+                results->emplace_back(std::move(res));
+            }
+        } catch (const std::exception& e) {
+            throw support::exception(TRACEMSG(e.what() +
+                    "\nError applying template op: [" + sl::support::to_string(i) + "]"));
+        }
+    }
+    return ctx;
+}
+
+int64_t parse_template_handle(sl::io::span<const char> data) {
+    enum { f_handle };
+    static const field_schema schema{
+        { "pdfTemplateHandle", true }
+    };
     // json parse
-    auto json = sl::json::load(data);
+    auto json = load_json(data);
     int64_t handle = -1;
-    int32_t beginX = -1;
-    int32_t beginY = -1;
-    int32_t endX = -1;
-    int32_t endY = -1;
-    float lineWidth = 1;
-    auto color = rgb_color();
-    for (const sl::json::field& fi : json.as_object()) {
-        auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else if ("beginX" == name) {
-            beginX = fi.as_uint16_or_throw(name);
-        } else if ("beginY" == name) {
-            beginY = fi.as_uint16_or_throw(name);
-        } else if ("endX" == name) {
-            endX = fi.as_uint16_or_throw(name);
-        } else if ("endY" == name) {
-            endY = fi.as_uint16_or_throw(name);
-        } else if ("color" == name) {
-            color = rgb_color(fi.val());
-        } else if ("lineWidth" == name) {
-            lineWidth = ungarble_float(fi.val(), "lineWidth");
-        } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+    schema.bind(json, [&handle](int id, const sl::json::field& fi) {
+        switch (id) {
+        case f_handle: handle = fi.as_int64_or_throw(fi.name()); break;
         }
+    });
+    return handle;
+}
+
+} // namespace
+
+support::buffer create_document(sl::io::span<const char>) {
+    auto ctx = doc_pool()->take();
+    if (nullptr == ctx.get()) {
+        ctx = new_document();
     }
-    if (-1 == handle) throw support::exception(TRACEMSG(
-            "Required parameter 'pdfDocumentHandle' not specified"));
-    if (-1 == beginX) throw support::exception(TRACEMSG(
-            "Required parameter 'beginX' not specified"));
-    if (-1 == beginY) throw support::exception(TRACEMSG(
-            "Required parameter 'beginY' not specified"));
-    if (-1 == endX) throw support::exception(TRACEMSG(
-            "Required parameter 'endX' not specified"));
-    if (-1 == endY) throw support::exception(TRACEMSG(
-            "Required parameter 'endY' not specified"));
-    // get handle
+    auto pdoc = std::make_shared<pdf_document>(std::move(ctx));
     auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
-            "Invalid 'pdfDocumentHandle' parameter specified"));
-    auto deferred = sl::support::defer([reg, doc]() STATICLIB_NOEXCEPT {
-        reg->put(doc);
+    int64_t handle = reg->put(std::move(pdoc));
+    shared_counters()->documents_created.fetch_add(1, std::memory_order_relaxed);
+    return support::make_json_buffer({
+        { "pdfDocumentHandle", handle}
     });
-    // call haru
-    HPDF_Page page = HPDF_GetCurrentPage(doc);
-    if (nullptr == page) throw support::exception(TRACEMSG(
-            "PDF generation error, cannot access current page," +
-            " please add at least one page to the document first"));
-    HPDF_Page_SetRGBStroke(page, color.r, color.g, color.b);
-    HPDF_Page_SetLineWidth(page, lineWidth);
-    HPDF_Page_MoveTo(page, static_cast<float>(beginX), static_cast<float>(beginY));
-    HPDF_Page_LineTo(page, static_cast<float>(endX), static_cast<float>(endY));
-    HPDF_Page_Stroke(page);
-    return support::make_null_buffer();
+}
+
+support::buffer load_font(sl::io::span<const char> data) {
+    return run_with_document(data, parse_load_font, apply_load_font);
+}
+
+support::buffer add_page(sl::io::span<const char> data) {
+    return run_with_document(data, parse_add_page, apply_add_page);
+}
+
+support::buffer write_text(sl::io::span<const char> data) {
+    return run_with_document_flat(data, parse_write_text_flat, parse_write_text, apply_write_text);
+}
+
+support::buffer write_text_inside_rectangle(sl::io::span<const char> data) {
+    return run_with_document_flat(data, parse_write_text_inside_rectangle_flat,
+            parse_write_text_inside_rectangle, apply_write_text_inside_rectangle);
+}
+
+support::buffer draw_line(sl::io::span<const char> data) {
+    return run_with_document_flat(data, parse_draw_line_flat, parse_draw_line, apply_draw_line);
 }
 
 support::buffer draw_rectangle(sl::io::span<const char> data) {
+    return run_with_document_flat(data, parse_draw_rectangle_flat, parse_draw_rectangle, apply_draw_rectangle);
+}
+
+support::buffer load_image(sl::io::span<const char> data) {
+    return run_with_document(data, parse_load_image, apply_load_image);
+}
+
+support::buffer draw_image(sl::io::span<const char> data) {
+    return run_with_document(data, parse_draw_image, apply_draw_image);
+}
+
+support::buffer save_to_file(sl::io::span<const char> data) {
+    return run_with_document(data, parse_save_to_file, apply_save_to_file);
+}
+
+support::buffer save_to_stream(sl::io::span<const char> data) {
+    return run_with_document(data, parse_save_to_stream, apply_save_to_stream);
+}
+
+support::buffer save_to_buffer(sl::io::span<const char> data) {
+    enum { f_handle };
+    static const field_schema schema{
+        { "pdfDocumentHandle", true }
+    };
     // json parse
-    auto json = sl::json::load(data);
+    auto json = load_json(data);
     int64_t handle = -1;
-    int32_t x = -1;
-    int32_t y = -1;
-    int32_t width = -1;
-    int32_t height = -1;
-    float lineWidth = 1;
-    auto color = rgb_color();
-    for (const sl::json::field& fi : json.as_object()) {
-        auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else if ("x" == name) {
-            x = fi.as_uint16_or_throw(name);
-        } else if ("y" == name) {
-            y = fi.as_uint16_or_throw(name);
-        } else if ("width" == name) {
-            width = fi.as_uint16_or_throw(name);
-        } else if ("height" == name) {
-            height = fi.as_uint16_or_throw(name);
-        } else if ("color" == name) {
-            color = rgb_color(fi.val());
-        } else if ("lineWidth" == name) {
-            lineWidth = ungarble_float(fi.val(), "lineWidth");
-        } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+    schema.bind(json, [&handle](int id, const sl::json::field& fi) {
+        switch (id) {
+        case f_handle: handle = fi.as_int64_or_throw(fi.name()); break;
         }
-    }
-    if (-1 == handle) throw support::exception(TRACEMSG(
-            "Required parameter 'pdfDocumentHandle' not specified"));
-    if (-1 == x) throw support::exception(TRACEMSG(
-            "Required parameter 'x' not specified"));
-    if (-1 == y) throw support::exception(TRACEMSG(
-            "Required parameter 'y' not specified"));
-    if (-1 == width) throw support::exception(TRACEMSG(
-            "Required parameter 'width' not specified"));
-    if (-1 == height) throw support::exception(TRACEMSG(
-            "Required parameter 'height' not specified"));
-    // get handle
-    auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
-            "Invalid 'pdfDocumentHandle' parameter specified"));
-    auto deferred = sl::support::defer([reg, doc]() STATICLIB_NOEXCEPT {
-        reg->put(doc);
     });
+    // get handle
+    auto pdoc = find_document(handle);
     // call haru
-    HPDF_Page page = HPDF_GetCurrentPage(doc);
-    if (nullptr == page) throw support::exception(TRACEMSG(
-            "PDF generation error, cannot access current page," +
-            " please add at least one page to the document first"));
-    HPDF_Page_SetRGBStroke(page, color.r, color.g, color.b);
-    HPDF_Page_SetLineWidth(page, lineWidth);
-    HPDF_Page_Rectangle(page, static_cast<float>(x), static_cast<float>(y), static_cast<float>(width), static_cast<float>(height));
-    HPDF_Page_Stroke(page);
-    return support::make_null_buffer();
+    return pdoc->execute([](pdf_context& ctx) {
+        return save_to_memory(ctx.doc);
+    });
 }
 
-support::buffer draw_image(sl::io::span<const char> data) {
+support::buffer execute_batch(sl::io::span<const char> data) {
+    enum { f_handle, f_ops, f_stop_on_error };
+    static const field_schema schema{
+        { "pdfDocumentHandle", true },
+        { "ops", true },
+        { "stopOnError", false }
+    };
     // json parse
-    auto json = sl::json::load(data);
+    auto json = load_json(data);
     int64_t handle = -1;
-    int32_t x = -1;
-    int32_t y = -1;
-    int32_t width = -1;
-    int32_t height = -1;
-    auto rimage_hex = std::ref(sl::utils::empty_string());
-    auto rimage_path = std::ref(sl::utils::empty_string());
-    auto rformat = std::ref(sl::utils::empty_string());
-    for (const sl::json::field& fi : json.as_object()) {
+    const sl::json::value* ops = nullptr;
+    bool stop_on_error = false;
+    schema.bind(json, [&](int id, const sl::json::field& fi) {
         auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else if ("x" == name) {
-            x = fi.as_uint16_or_throw(name);
-        } else if ("y" == name) {
-            y = fi.as_uint16_or_throw(name);
-        } else if ("width" == name) {
-            width = fi.as_uint16_or_throw(name);
-        } else if ("height" == name) {
-            height = fi.as_uint16_or_throw(name);
-        } else if ("imageHex" == name) {
-            rimage_hex = fi.as_string_nonempty_or_throw(name);
-        } else if ("imagePath" == name) {
-            rimage_path = fi.as_string_nonempty_or_throw(name);
-        } else if ("imageFormat" == name) {
-            rformat = fi.as_string_nonempty_or_throw(name);
-        } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+        switch (id) {
+        case f_handle: handle = fi.as_int64_or_throw(name); break;
+        case f_ops: fi.as_array_or_throw(name); ops = std::addressof(fi.val()); break;
+        case f_stop_on_error: stop_on_error = fi.as_bool_or_throw(name); break;
         }
-    }
-    if (-1 == handle) throw support::exception(TRACEMSG(
-            "Required parameter 'pdfDocumentHandle' not specified"));
-    if (-1 == x) throw support::exception(TRACEMSG(
-            "Required parameter 'x' not specified"));
-    if (-1 == y) throw support::exception(TRACEMSG(
-            "Required parameter 'y' not specified"));
-    if (-1 == width) throw support::exception(TRACEMSG(
-            "Required parameter 'width' not specified"));
-    if (-1 == height) throw support::exception(TRACEMSG(
-            "Required parameter 'height' not specified"));
-    if (rformat.get().empty()) throw support::exception(TRACEMSG(
-            "Required parameter 'imageFormat' not specified"));
-    const std::string& image_hex = rimage_hex.get();
-    const std::string& image_path = rimage_path.get();
-    if ((image_hex.empty() && image_path.empty()) ||
-            (!image_hex.empty() && !image_path.empty())) throw support::exception(TRACEMSG(
-            "Either 'imageHex' or 'imagePath' must be specified"));
-    const std::string& format = rformat.get();
-    // check that input is PNG or JPEG
-    if ("PNG" != format && "JPEG" != format) throw support::exception(TRACEMSG(
-            "Invalid 'imageFormat' specified: [" + format + "], supported formats: [PNG, JPEG]"));
+    });
     // get handle
-    auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
-            "Invalid 'pdfDocumentHandle' parameter specified"));
-    auto deferred = sl::support::defer([reg, doc]() STATICLIB_NOEXCEPT {
-        reg->put(doc);
+    auto pdoc = find_document(handle);
+    // call haru for every op, failed ops are reported by index
+    auto results = std::vector<sl::json::value>();
+    auto errors = std::vector<sl::json::value>();
+    pdoc->execute([ops, stop_on_error, &results, &errors](pdf_context& ctx) {
+        auto& ops_list = ops->as_array();
+        for (size_t i = 0; i < ops_list.size(); i++) {
+            try {
+                results.emplace_back(execute_batched_op(ctx, ops_list.at(i)));
+            } catch (const std::exception& e) {
+                // failed op may leave the page inside of text or path object
+                bool restored = restore_page_state(ctx.doc);
+                results.emplace_back(nullptr);
+                auto msg = std::string(e.what());
+                if (!restored) {
+                    msg += "\nPage state cannot be restored, remaining ops are skipped";
+                }
+                errors.push_back({
+                    { "index", static_cast<int64_t>(i) },
+                    { "message", TRACEMSG(msg) }
+                });
+                if (stop_on_error || !restored) {
+                    break;
+                }
+            }
+        }
+    });
+    return support::make_json_buffer({
+        { "results", std::move(results) },
+        { "errors", std::move(errors) }
     });
+}
+
+support::buffer render_document(sl::io::span<const char> data) {
+    enum { f_fonts, f_pages };
+    static const field_schema schema{
+        { "fonts", false },
+        { "pages", true }
+    };
+    enum { f_font_path, f_font_alias };
+    static const field_schema font_schema{
+        { "path", true },
+        { "alias", true }
+    };
+    enum { f_page_size, f_page_ops };
+    static const field_schema page_schema{
+        { "size", true },
+        { "ops", false }
+    };
+    // json parse
+    auto json = load_json(data);
+    const sl::json::value* fonts = nullptr;
+    const sl::json::value* pages = nullptr;
+    schema.bind(json, [&fonts, &pages](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (id) {
+        case f_fonts: fi.as_array_or_throw(name); fonts = std::addressof(fi.val()); break;
+        case f_pages: fi.as_array_or_throw(name); pages = std::addressof(fi.val()); break;
+        }
+    });
+    if (pages->as_array().empty()) throw support::exception(TRACEMSG(
+            "Required parameter 'pages' not specified"));
+    // document is local to this call, not registered
+    auto pooled = doc_pool()->take();
+    if (nullptr == pooled.get()) {
+        pooled = new_document();
+    }
+    pdf_context& ctx = *pooled;
+    memory_scope scope(ctx.memory.get());
+    phase_scope phase(call_phase::haru);
     // call haru
-    HPDF_Page page = HPDF_GetCurrentPage(doc);
-    if (nullptr == page) throw support::exception(TRACEMSG(
-            "PDF generation error, cannot access current page," +
-            " please add at least one page to the document first"));
+    if (nullptr != fonts) {
+        for (auto& font_json : fonts->as_array()) {
+            auto args = load_font_args();
+            auto ralias = std::ref(sl::utils::empty_string());
+            font_json.as_object_or_throw("fonts");
+            font_schema.bind(font_json, [&args, &ralias](int id, const sl::json::field& fi) {
+                auto& name = fi.name();
+                switch (id) {
+                case f_font_path: args.path = fi.as_string_nonempty_or_throw(name); break;
+                case f_font_alias: ralias = fi.as_string_nonempty_or_throw(name); break;
+                }
+            });
+            const std::string& alias = ralias.get();
+            if (ctx.font_aliases.count(alias) > 0) throw support::exception(TRACEMSG(
+                    "Duplicate font alias specified: [" + alias + "]"));
+            auto loaded = apply_load_font(ctx, args);
+            ctx.font_aliases.emplace(alias, loaded["fontName"].as_string());
+        }
+    }
+    auto& pages_list = pages->as_array();
+    for (size_t i = 0; i < pages_list.size(); i++) {
+        const sl::json::value* size = nullptr;
+        const sl::json::value* ops = nullptr;
+        try {
+            auto& page_json = pages_list.at(i);
+            page_json.as_object_or_throw("pages");
+            page_schema.bind(page_json, [&size, &ops](int id, const sl::json::field& fi) {
+                auto& name = fi.name();
+                switch (id) {
+                case f_page_size: fi.as_object_or_throw(name); size = std::addressof(fi.val()); break;
+                case f_page_ops: fi.as_array_or_throw(name); ops = std::addressof(fi.val()); break;
+                }
+            });
+            run_batched(ctx, *size, parse_add_page, apply_add_page);
+        } catch (const std::exception& e) {
+            throw support::exception(TRACEMSG(e.what() +
+                    "\nError rendering page: [" + sl::support::to_string(i) + "]"));
+        }
+        if (nullptr == ops) {
+            continue;
+        }
+        auto& ops_list = ops->as_array();
+        for (size_t j = 0; j < ops_list.size(); j++) {
+            try {
+                execute_batched_op(ctx, ops_list.at(j), dispatch_render_op);
+            } catch (const std::exception& e) {
+                throw support::exception(TRACEMSG(e.what() +
+                        "\nError rendering page: [" + sl::support::to_string(i) + "]," +
+                        " op: [" + sl::support::to_string(j) + "]"));
+            }
+        }
+    }
+    return save_to_memory(ctx.doc);
+}
 
-    HPDF_Image image = nullptr;
-    if (!image_hex.empty()) {
-        image = load_image_from_hex(doc, image_hex, format);
+support::buffer create_template(sl::io::span<const char> data) {
+    enum { f_ops, f_pool_size };
+    static const field_schema schema{
+        { "ops", true },
+        { "poolSize", false }
+    };
+    // json parse
+    auto json = load_json(data);
+    const sl::json::value* ops = nullptr;
+    int64_t pool_size = 0;
+    schema.bind(json, [&ops, &pool_size](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (id) {
+        case f_ops: fi.as_array_or_throw(name); ops = std::addressof(fi.val()); break;
+        case f_pool_size:
+            pool_size = fi.as_int64_or_throw(name);
+            if (pool_size < 0) throw support::exception(TRACEMSG(
+                    "Invalid 'poolSize' parameter specified," +
+                    " value: [" + sl::support::to_string(pool_size) + "]"));
+            break;
+        }
+    });
+    // ops are checked and their results are collected once,
+    // documents built later get the same results
+    check_template_ops(*ops);
+    auto shared_ops = std::make_shared<sl::json::value>(ops->clone());
+    auto results = std::vector<sl::json::value>();
+    auto first = new_document_from_ops(*shared_ops, std::addressof(results));
+    auto tpl = std::make_shared<pdf_template>([shared_ops] {
+        return new_document_from_ops(*shared_ops, nullptr);
+    }, sl::json::value(std::move(results)), std::move(first), static_cast<size_t>(pool_size),
+            shared_refiller());
+    auto reg = template_registry();
+    int64_t handle = reg->put(std::move(tpl));
+    return support::make_json_buffer({
+        { "pdfTemplateHandle", handle }
+    });
+}
+
+support::buffer fork_template(sl::io::span<const char> data) {
+    auto handle = parse_template_handle(data);
+    auto tpl = template_registry()->peek(handle);
+    if (nullptr == tpl.get()) throw support::exception(TRACEMSG(
+            "Invalid 'pdfTemplateHandle' parameter specified"));
+    auto pdoc = std::make_shared<pdf_document>(tpl->fork());
+    auto reg = doc_registry();
+    int64_t doc_handle = reg->put(std::move(pdoc));
+    shared_counters()->documents_created.fetch_add(1, std::memory_order_relaxed);
+    return support::make_json_buffer({
+        { "pdfDocumentHandle", doc_handle },
+        { "results", tpl->prefix_results().clone() }
+    });
+}
+
+support::buffer get_template_stats(sl::io::span<const char> data) {
+    auto handle = parse_template_handle(data);
+    auto tpl = template_registry()->peek(handle);
+    if (nullptr == tpl.get()) throw support::exception(TRACEMSG(
+            "Invalid 'pdfTemplateHandle' parameter specified"));
+    return support::make_json_buffer(tpl->stats());
+}
+
+support::buffer destroy_template(sl::io::span<const char> data) {
+    auto handle = parse_template_handle(data);
+    auto tpl = template_registry()->remove(handle);
+    if (nullptr == tpl.get()) throw support::exception(TRACEMSG(
+            "Invalid 'pdfTemplateHandle' parameter specified"));
+    return support::make_null_buffer();
+}
+
+support::buffer register_buffer(sl::io::span<const char> data) {
+    enum { f_hex, f_base64, f_path };
+    static const field_schema schema{
+        { "hex", false },
+        { "base64", false },
+        { "path", false }
+    };
+    auto json = load_json(data);
+    auto source = image_source();
+    schema.bind(json, [&source](int id, const sl::json::field& fi) {
+        auto& name = fi.name();
+        switch (id) {
+        case f_hex: source.hex = fi.as_string_nonempty_or_throw(name); break;
+        case f_base64: source.base64 = fi.as_string_nonempty_or_throw(name); break;
+        case f_path: source.path = fi.as_string_nonempty_or_throw(name); break;
+        }
+    });
+    if (1 != source.inputs_count()) throw support::exception(TRACEMSG(
+            "Either 'hex', 'base64' or 'path' must be specified"));
+    auto buf = std::shared_ptr<registered_buffer>();
+    if (!source.hex.get().empty()) {
+        auto bytes = decode_hex({source.hex.get().data(), source.hex.get().length()});
+        buf = std::make_shared<registered_buffer>(std::move(bytes));
+    } else if (!source.base64.get().empty()) {
+        auto bytes = decode_base64({source.base64.get().data(), source.base64.get().length()});
+        buf = std::make_shared<registered_buffer>(std::move(bytes));
     } else {
-        image = load_image_from_file(doc, image_path, format);
+        // file is read into memory owned by the buffer
+        auto contents = [&source] {
+            phase_scope phase(call_phase::io);
+            return sl::support::make_unique<file_contents>(source.path.get());
+        } ();
+        buf = std::make_shared<registered_buffer>(std::move(contents));
     }
-    HPDF_Page_DrawImage(page, image, static_cast<HPDF_REAL>(x), static_cast<HPDF_REAL>(y),
-            static_cast<HPDF_REAL>(width), static_cast<HPDF_REAL>(height));
+    auto size = static_cast<int64_t>(buf->size());
+    int64_t buffer_id = buffer_registry()->put(std::move(buf));
+    return support::make_json_buffer({
+        { "bufferId", buffer_id },
+        { "size", size }
+    });
+}
 
+support::buffer unregister_buffer(sl::io::span<const char> data) {
+    enum { f_buffer_id };
+    static const field_schema schema{
+        { "bufferId", true }
+    };
+    auto json = load_json(data);
+    int64_t buffer_id = -1;
+    schema.bind(json, [&buffer_id](int id, const sl::json::field& fi) {
+        switch (id) {
+        case f_buffer_id: buffer_id = fi.as_int64_or_throw(fi.name()); break;
+        }
+    });
+    // calls that already use the buffer keep it until they finish
+    auto buf = buffer_registry()->remove(buffer_id);
+    if (nullptr == buf.get()) throw support::exception(TRACEMSG(
+            "Invalid 'bufferId' parameter specified, value: [" + sl::support::to_string(buffer_id) + "]"));
     return support::make_null_buffer();
 }
 
-support::buffer save_to_file(sl::io::span<const char> data) {
+support::buffer configure(sl::io::span<const char> data) {
+    enum {
+        f_image_cache_max_bytes, f_mem_pool_block_size, f_document_memory_limit, f_global_memory_limit,
+        f_decoded_image_memory_limit, f_record_path, f_document_pool_size, f_document_pool_fonts
+    };
+    static const field_schema schema{
+        { "imageCacheMaxBytes", false },
+        { "memPoolBlockSize", false },
+        { "documentMemoryLimit", false },
+        { "globalMemoryLimit", false },
+        { "decodedImageMemoryLimit", false },
+        { "recordPath", false },
+        { "documentPoolSize", false },
+        { "documentPoolFonts", false }
+    };
     // json parse
-    auto json = sl::json::load(data);
-    int64_t handle = -1;
-    auto rpath = std::ref(sl::utils::empty_string());
-    for (const sl::json::field& fi : json.as_object()) {
+    auto json = load_json(data);
+    int64_t image_cache_max_bytes = -1;
+    int64_t mem_pool_block_size_val = -1;
+    auto record_path = std::ref(sl::utils::empty_string());
+    bool record_path_set = false;
+    int64_t document_memory_limit = -1;
+    int64_t global_memory_limit = -1;
+    int64_t decoded_image_memory_limit = -1;
+    int64_t document_pool_size = -1;
+    auto document_pool_fonts = std::vector<std::string>();
+    // non-negative values only
+    auto read_size = [](const sl::json::field& fi) {
+        int64_t val = fi.as_int64_or_throw(fi.name());
+        if (val < 0) throw support::exception(TRACEMSG(
+                "Invalid '" + fi.name() + "' parameter specified," +
+                " value: [" + sl::support::to_string(val) + "]"));
+        return val;
+    };
+    schema.bind(json, [&](int id, const sl::json::field& fi) {
         auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else if ("path" == name) {
-            rpath = fi.as_string_nonempty_or_throw(name);
-        } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+        switch (id) {
+        case f_image_cache_max_bytes: image_cache_max_bytes = read_size(fi); break;
+        case f_mem_pool_block_size:
+            mem_pool_block_size_val = fi.as_int64_or_throw(name);
+            if (!(0 == mem_pool_block_size_val || (mem_pool_block_size_val >= (1 << 12) &&
+                    mem_pool_block_size_val <= (1 << 26)))) throw support::exception(TRACEMSG(
+                    "Invalid 'memPoolBlockSize' parameter specified," +
+                    " value: [" + sl::support::to_string(mem_pool_block_size_val) + "]," +
+                    " must be 0 or between 4096 and 67108864"));
+            break;
+        case f_document_memory_limit: document_memory_limit = read_size(fi); break;
+        case f_global_memory_limit: global_memory_limit = read_size(fi); break;
+        case f_decoded_image_memory_limit: decoded_image_memory_limit = read_size(fi); break;
+        case f_record_path:
+            record_path = fi.as_string_or_throw(name);
+            record_path_set = true;
+            break;
+        case f_document_pool_size: document_pool_size = read_size(fi); break;
+        case f_document_pool_fonts:
+            for (auto& el : fi.as_array_or_throw(name)) {
+                document_pool_fonts.emplace_back(el.as_string_nonempty_or_throw(name));
+            }
+            break;
         }
-    }
-    if (-1 == handle) throw support::exception(TRACEMSG(
-            "Required parameter 'pdfDocumentHandle' not specified"));
-    if (rpath.get().empty()) throw support::exception(TRACEMSG(
-            "Required parameter 'path' not specified"));
-    const std::string& path = rpath.get();
-    // get handle
-    auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
-            "Invalid 'pdfDocumentHandle' parameter specified"));
-    auto deferred = sl::support::defer([reg, doc]() STATICLIB_NOEXCEPT {
-        reg->put(doc);
     });
-    // call haru
-    HPDF_SaveToFile(doc, path.c_str());
+    if (!document_pool_fonts.empty() && -1 == document_pool_size) throw support::exception(TRACEMSG(
+            "Required parameter 'documentPoolSize' not specified"));
+    if (-1 != image_cache_max_bytes) {
+        shared_image_cache()->set_max_bytes(static_cast<uint64_t>(image_cache_max_bytes));
+    }
+    if (-1 != mem_pool_block_size_val) {
+        mem_pool_block_size().store(static_cast<uint32_t>(mem_pool_block_size_val), std::memory_order_relaxed);
+    }
+    if (-1 != document_memory_limit) {
+        memory_limits::document_limit().store(static_cast<uint64_t>(document_memory_limit), std::memory_order_relaxed);
+    }
+    if (-1 != global_memory_limit) {
+        memory_limits::global_limit().store(static_cast<uint64_t>(global_memory_limit), std::memory_order_relaxed);
+    }
+    if (-1 != decoded_image_memory_limit) {
+        memory_limits::decoded_image_limit().store(static_cast<uint64_t>(decoded_image_memory_limit),
+                std::memory_order_relaxed);
+    }
+    if (record_path_set) {
+        shared_recorder()->start(record_path.get());
+    }
+    if (-1 != document_pool_size) {
+        auto fonts = std::make_shared<std::vector<std::string>>(std::move(document_pool_fonts));
+        doc_pool()->configure(static_cast<size_t>(document_pool_size), [fonts] {
+            return new_document_with_fonts(*fonts);
+        });
+    }
     return support::make_null_buffer();
 }
 
+support::buffer get_image_cache_stats(sl::io::span<const char>) {
+    auto stats = shared_image_cache()->stats();
+    return support::make_json_buffer(stats);
+}
+
+support::buffer get_stats(sl::io::span<const char> data) {
+    bool reset = false;
+    if (data.size() > 0) {
+        enum { f_reset };
+        static const field_schema schema{
+            { "reset", false }
+        };
+        auto json = load_json(data);
+        schema.bind(json, [&reset](int id, const sl::json::field& fi) {
+            switch (id) {
+            case f_reset: reset = fi.as_bool_or_throw(fi.name()); break;
+            }
+        });
+    }
+    auto stats = shared_call_stats();
+    auto res = stats->to_json();
+    if (reset) {
+        stats->reset();
+    }
+    return support::make_json_buffer(res);
+}
+
+support::buffer get_metrics_prometheus(sl::io::span<const char>) {
+    auto counters = shared_counters();
+    auto created = counters->documents_created.load(std::memory_order_relaxed);
+    auto destroyed = counters->documents_destroyed.load(std::memory_order_relaxed);
+    auto images = shared_image_cache()->stats();
+    auto fonts = shared_font_stats()->stats();
+    auto pool = doc_pool()->stats();
+    prometheus_writer pw;
+    pw.counter("wilton_pdf_documents_created_total", "Documents created", created);
+    pw.counter("wilton_pdf_documents_destroyed_total", "Documents destroyed", destroyed);
+    pw.gauge("wilton_pdf_documents_live", "Documents currently registered",
+            created >= destroyed ? created - destroyed : 0);
+    pw.counter("wilton_pdf_images_loaded_total", "Images embedded into documents",
+            counters->images_loaded.load(std::memory_order_relaxed));
+    pw.counter("wilton_pdf_image_validation_failures_total", "Images rejected by validation",
+            counters->validation_failures.load(std::memory_order_relaxed));
+    pw.counter("wilton_pdf_saved_bytes_total", "Bytes of PDF output produced",
+            counters->bytes_saved.load(std::memory_order_relaxed));
+    pw.gauge("wilton_pdf_memory_bytes",
+            "Memory charged to memory accounts: haru allocations, decoded images and other reservations",
+            memory_limits::total_used().load(std::memory_order_relaxed));
+    pw.family("wilton_pdf_cache_hits_total", "counter", "Cache lookups served from cache");
+    pw.sample("wilton_pdf_cache_hits_total", prometheus_writer::label("cache", "image"),
+            static_cast<uint64_t>(images["hits"].as_int64()));
+    pw.sample("wilton_pdf_cache_hits_total", prometheus_writer::label("cache", "document_pool"),
+            static_cast<uint64_t>(pool["hits"].as_int64()));
+    pw.family("wilton_pdf_cache_misses_total", "counter", "Cache lookups that were not served from cache");
+    pw.sample("wilton_pdf_cache_misses_total", prometheus_writer::label("cache", "image"),
+            static_cast<uint64_t>(images["misses"].as_int64()));
+    pw.sample("wilton_pdf_cache_misses_total", prometheus_writer::label("cache", "document_pool"),
+            static_cast<uint64_t>(pool["misses"].as_int64()));
+    pw.counter("wilton_pdf_font_parses_total", "TrueType fonts parsed by haru",
+            static_cast<uint64_t>(fonts["parses"].as_int64()));
+    pw.counter("wilton_pdf_font_loads_reused_total", "Font loads served from the per-document memo",
+            static_cast<uint64_t>(fonts["loadsReused"].as_int64()));
+    auto& calls = shared_call_stats()->list();
+    pw.family("wilton_pdf_call_errors_total", "counter", "Calls failed with error");
+    for (auto& cs : calls) {
+        pw.sample("wilton_pdf_call_errors_total", prometheus_writer::label("call", cs->name),
+                cs->errors.load(std::memory_order_relaxed));
+    }
+    pw.family("wilton_pdf_call_duration_seconds", "histogram", "Call latency, total and by phase");
+    for (auto& cs : calls) {
+        auto call_label = prometheus_writer::label("call", cs->name);
+        pw.histogram("wilton_pdf_call_duration_seconds", call_label + "," +
+                prometheus_writer::label("phase", "total"), cs->total);
+        for (size_t i = 0; i < call_phases_count; i++) {
+            pw.histogram("wilton_pdf_call_duration_seconds", call_label + "," +
+                    prometheus_writer::label("phase", call_phase_name(i)), cs->phases[i]);
+        }
+    }
+    return support::make_string_buffer(pw.str());
+}
+
+support::buffer get_memory_usage(sl::io::span<const char>) {
+    auto documents = std::vector<sl::json::value>();
+    for (auto& en : doc_registry()->list()) {
+        documents.push_back({
+            { "pdfDocumentHandle", en.first },
+            { "bytes", static_cast<int64_t>(en.second->memory_used()) }
+        });
+    }
+    uint64_t buffers_bytes = 0;
+    auto buffers = buffer_registry()->list();
+    for (auto& en : buffers) {
+        buffers_bytes += en.second->data().size();
+    }
+    return support::make_json_buffer({
+        { "totalBytes", static_cast<int64_t>(memory_limits::total_used().load(std::memory_order_relaxed)) },
+        { "registeredBuffers", static_cast<int64_t>(buffers.size()) },
+        { "registeredBuffersBytes", static_cast<int64_t>(buffers_bytes) },
+        { "documentMemoryLimit", static_cast<int64_t>(memory_limits::document_limit().load(std::memory_order_relaxed)) },
+        { "globalMemoryLimit", static_cast<int64_t>(memory_limits::global_limit().load(std::memory_order_relaxed)) },
+        { "decodedImageMemoryLimit", static_cast<int64_t>(memory_limits::decoded_image_limit().load(std::memory_order_relaxed)) },
+        { "documents", std::move(documents) }
+    });
+}
+
+support::buffer get_document_pool_stats(sl::io::span<const char>) {
+    auto stats = doc_pool()->stats();
+    return support::make_json_buffer(stats);
+}
+
+support::buffer get_font_stats(sl::io::span<const char>) {
+    auto stats = shared_font_stats()->stats();
+    return support::make_json_buffer(stats);
+}
+
 support::buffer destroy_document(sl::io::span<const char> data) {
+    enum { f_handle };
+    static const field_schema schema{
+        { "pdfDocumentHandle", true }
+    };
     // json parse
-    auto json = sl::json::load(data);
+    auto json = load_json(data);
     int64_t handle = -1;
-    for (const sl::json::field& fi : json.as_object()) {
-        auto& name = fi.name();
-        if ("pdfDocumentHandle" == name) {
-            handle = fi.as_int64_or_throw(name);
-        } else {
-            throw support::exception(TRACEMSG("Unknown data field: [" + name + "]"));
+    schema.bind(json, [&handle](int id, const sl::json::field& fi) {
+        switch (id) {
+        case f_handle: handle = fi.as_int64_or_throw(fi.name()); break;
         }
-    }
-    if (-1 == handle) throw support::exception(TRACEMSG(
-            "Required parameter 'pdfDocumentHandle' not specified"));
+    });
     // get handle
     auto reg = doc_registry();
-    HPDF_Doc doc = reg->remove(handle);
-    if (nullptr == doc) throw support::exception(TRACEMSG(
+    auto pdoc = reg->remove(handle);
+    if (nullptr == pdoc.get()) throw support::exception(TRACEMSG(
             "Invalid 'pdfDocumentHandle' parameter specified"));
-    // call haru
-    HPDF_Free(doc);
+    // call haru, ops that are already submitted are completed first
+    pdoc->destroy();
+    shared_counters()->documents_destroyed.fetch_add(1, std::memory_order_relaxed);
     return support::make_null_buffer();
 }
 
@@ -727,22 +1743,57 @@ support::buffer test(sl::io::span<const char> data) {
 }
  * */
 
+// refiller thread builds documents using other singletons, so it is
+// stopped before any singleton, that was initialized earlier, is destroyed
+void shutdown_module() {
+    shared_refiller()->stop();
+}
+
 } // namespace
 }
 
 extern "C" char* wilton_module_init() {
     try {
         wilton::pdf::doc_registry();
-        wilton::support::register_wiltoncall("pdf_create_document", wilton::pdf::create_document);
-        wilton::support::register_wiltoncall("pdf_load_font", wilton::pdf::load_font);
-        wilton::support::register_wiltoncall("pdf_add_page", wilton::pdf::add_page);
-        wilton::support::register_wiltoncall("pdf_write_text", wilton::pdf::write_text);
-        wilton::support::register_wiltoncall("pdf_write_text_inside_rectangle", wilton::pdf::write_text_inside_rectangle);
-        wilton::support::register_wiltoncall("pdf_draw_line", wilton::pdf::draw_line);
-        wilton::support::register_wiltoncall("pdf_draw_rectangle", wilton::pdf::draw_rectangle);
-        wilton::support::register_wiltoncall("pdf_draw_image", wilton::pdf::draw_image);
-        wilton::support::register_wiltoncall("pdf_save_to_file", wilton::pdf::save_to_file);
-        wilton::support::register_wiltoncall("pdf_destroy_document", wilton::pdf::destroy_document);
+        wilton::pdf::shared_call_stats();
+        wilton::pdf::shared_counters();
+        wilton::pdf::shared_recorder();
+        wilton::pdf::shared_image_cache();
+        wilton::pdf::shared_font_stats();
+        wilton::pdf::shared_refiller();
+        wilton::pdf::doc_pool();
+        wilton::pdf::template_registry();
+        wilton::pdf::buffer_registry();
+        // registered after all singletons, so it runs before their destructors
+        std::atexit(wilton::pdf::shutdown_module);
+        wilton::pdf::register_call("pdf_create_document", wilton::pdf::create_document);
+        wilton::pdf::register_call("pdf_load_font", wilton::pdf::load_font);
+        wilton::pdf::register_call("pdf_add_page", wilton::pdf::add_page);
+        wilton::pdf::register_call("pdf_write_text", wilton::pdf::write_text);
+        wilton::pdf::register_call("pdf_write_text_inside_rectangle", wilton::pdf::write_text_inside_rectangle);
+        wilton::pdf::register_call("pdf_draw_line", wilton::pdf::draw_line);
+        wilton::pdf::register_call("pdf_draw_rectangle", wilton::pdf::draw_rectangle);
+        wilton::pdf::register_call("pdf_load_image", wilton::pdf::load_image);
+        wilton::pdf::register_call("pdf_draw_image", wilton::pdf::draw_image);
+        wilton::pdf::register_call("pdf_save_to_file", wilton::pdf::save_to_file);
+        wilton::pdf::register_call("pdf_save_to_buffer", wilton::pdf::save_to_buffer);
+        wilton::pdf::register_call("pdf_save_to_stream", wilton::pdf::save_to_stream);
+        wilton::pdf::register_call("pdf_destroy_document", wilton::pdf::destroy_document);
+        wilton::pdf::register_call("pdf_execute_batch", wilton::pdf::execute_batch);
+        wilton::pdf::register_call("pdf_render_document", wilton::pdf::render_document);
+        wilton::pdf::register_call("pdf_create_template", wilton::pdf::create_template);
+        wilton::pdf::register_call("pdf_fork_template", wilton::pdf::fork_template);
+        wilton::pdf::register_call("pdf_get_template_stats", wilton::pdf::get_template_stats);
+        wilton::pdf::register_call("pdf_destroy_template", wilton::pdf::destroy_template);
+        wilton::pdf::register_call("pdf_register_buffer", wilton::pdf::register_buffer);
+        wilton::pdf::register_call("pdf_unregister_buffer", wilton::pdf::unregister_buffer);
+        wilton::pdf::register_call("pdf_configure", wilton::pdf::configure);
+        wilton::pdf::register_call("pdf_get_image_cache_stats", wilton::pdf::get_image_cache_stats);
+        wilton::pdf::register_call("pdf_get_font_stats", wilton::pdf::get_font_stats);
+        wilton::pdf::register_call("pdf_get_stats", wilton::pdf::get_stats);
+        wilton::pdf::register_call("pdf_get_metrics_prometheus", wilton::pdf::get_metrics_prometheus);
+        wilton::pdf::register_call("pdf_get_memory_usage", wilton::pdf::get_memory_usage);
+        wilton::pdf::register_call("pdf_get_document_pool_stats", wilton::pdf::get_document_pool_stats);
         return nullptr;
     } catch (const std::exception& e) {
         return wilton::support::alloc_copy(TRACEMSG(e.what() + "\nException raised"));
@@ -0,0 +1,224 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   base64_decoder_test.cpp
+ * Author: alex
+ *
+ * Created on December 8, 2020, 11:22 AM
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "staticlib/config/assert.hpp"
+#include "staticlib/io.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "base64_decoder.hpp"
+
+namespace { // anonymous
+
+namespace pdf = wilton::pdf;
+
+// lengths up to 64 bytes cover several SSSE3 blocks and every tail length
+const size_t max_bytes = 64;
+
+const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// url-safe chars and neighbours of the alphabet ranges
+const std::string invalid_chars = std::string("-_*.,:@[`{~ \n") + std::string("\0\x7f\x80\xff", 4);
+
+// reference encoder and decoder, do not share code with the tested one
+
+std::string encode_reference(const std::vector<char>& data, bool padded) {
+    auto res = std::string();
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t acc = 0;
+        size_t count = std::min(static_cast<size_t>(3), data.size() - i);
+        for (size_t j = 0; j < 3; j++) {
+            acc <<= 8;
+            if (j < count) {
+                acc |= static_cast<unsigned char>(data[i + j]);
+            }
+        }
+        for (size_t j = 0; j < count + 1; j++) {
+            res.push_back(alphabet[(acc >> (18 - 6 * j)) & 0x3f]);
+        }
+        if (padded) {
+            res.append(3 - count, '=');
+        }
+    }
+    return res;
+}
+
+std::vector<char> decode_reference(const std::string& b64) {
+    auto res = std::vector<char>();
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char ch : b64) {
+        if ('=' == ch) {
+            break;
+        }
+        acc = (acc << 6) | static_cast<uint32_t>(alphabet.find(ch));
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            res.push_back(static_cast<char>((acc >> bits) & 0xff));
+        }
+    }
+    return res;
+}
+
+std::vector<char> random_bytes(std::mt19937& rng, size_t count) {
+    auto dist = std::uniform_int_distribution<int>(0, 255);
+    auto res = std::vector<char>();
+    for (size_t i = 0; i < count; i++) {
+        res.push_back(static_cast<char>(dist(rng)));
+    }
+    return res;
+}
+
+std::vector<char> decode(const std::string& b64) {
+    return pdf::decode_base64(sl::io::span<const char>(b64.data(), b64.length()));
+}
+
+// decoding must fail, reporting the specified position if it is not -1
+void check_invalid(const std::string& b64, size_t pos) {
+    bool thrown = false;
+    try {
+        decode(b64);
+    } catch (const wilton::support::exception& e) {
+        thrown = true;
+        if (static_cast<size_t>(-1) != pos) {
+            auto expected = "position: [" + sl::support::to_string(pos) + "]";
+            slassert(std::string::npos != std::string(e.what()).find(expected));
+        }
+    }
+    slassert(thrown);
+}
+
+void test_lengths() {
+    auto rng = std::mt19937(42);
+    for (size_t len = 0; len <= max_bytes; len++) {
+        for (size_t round = 0; round < 16; round++) {
+            auto data = random_bytes(rng, len);
+            auto padded = encode_reference(data, true);
+            auto unpadded = encode_reference(data, false);
+            slassert(data == decode_reference(padded));
+            slassert(data == decode(padded));
+            slassert(data == decode(unpadded));
+        }
+    }
+}
+
+void test_alphabet() {
+    // every char at every position within a block
+    auto b64 = std::string();
+    for (size_t i = 0; i < 4; i++) {
+        b64 += alphabet.substr(i) + alphabet.substr(0, i);
+    }
+    for (size_t from = 0; from < 64; from += 4) {
+        auto part = b64.substr(from, 128);
+        slassert(decode_reference(part) == decode(part));
+    }
+}
+
+void test_padding() {
+    // no padding, single and double padding
+    slassert(std::string("f") == std::string(decode("Zg==").data(), 1));
+    slassert(std::string("f") == std::string(decode("Zg").data(), 1));
+    slassert(std::string("fo") == std::string(decode("Zm8=").data(), 2));
+    slassert(std::string("fo") == std::string(decode("Zm8").data(), 2));
+    slassert(std::string("foo") == std::string(decode("Zm9v").data(), 3));
+    slassert(decode("").empty());
+    // padding is only accepted at the end of a complete quad
+    check_invalid("Zg=", 2);
+    check_invalid("Zm8=Zm8=", 3);
+    check_invalid("Zg==Zg", 2);
+    check_invalid("Z===", 1);
+    check_invalid("====", 0);
+    check_invalid("Zm9v=", -1);
+    check_invalid("Zm9v==", 4);
+    check_invalid("=", -1);
+    check_invalid("==", 0);
+    check_invalid("Zm=v", 2);
+    check_invalid("Z=9v", 1);
+    // padding in the middle of longer inputs
+    auto rng = std::mt19937(43);
+    for (size_t len = 3; len <= max_bytes; len += 3) {
+        auto b64 = encode_reference(random_bytes(rng, len), true);
+        for (size_t pos = 0; pos < b64.length() - 2; pos++) {
+            auto broken = b64;
+            broken[pos] = '=';
+            check_invalid(broken, pos);
+        }
+    }
+}
+
+void test_invalid_chars() {
+    auto rng = std::mt19937(44);
+    for (size_t len = 1; len <= max_bytes; len++) {
+        auto data = random_bytes(rng, len);
+        auto unpadded = encode_reference(data, false);
+        auto padded = encode_reference(data, true);
+        for (size_t pos = 0; pos < unpadded.length(); pos++) {
+            for (char ch : invalid_chars) {
+                auto broken = unpadded;
+                broken[pos] = ch;
+                check_invalid(broken, pos);
+                broken = padded;
+                broken[pos] = ch;
+                check_invalid(broken, pos);
+            }
+        }
+    }
+    // first invalid char is reported
+    auto b64 = encode_reference(random_bytes(rng, max_bytes), false);
+    b64[50] = '-';
+    b64[9] = '_';
+    check_invalid(b64, 9);
+}
+
+void test_length_mod_one() {
+    auto rng = std::mt19937(45);
+    for (size_t len = 0; len <= max_bytes; len += 3) {
+        auto b64 = encode_reference(random_bytes(rng, len), false) + "Q";
+        check_invalid(b64, -1);
+    }
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_lengths();
+        test_alphabet();
+        test_padding();
+        test_invalid_chars();
+        test_length_mod_one();
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
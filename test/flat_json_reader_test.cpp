@@ -0,0 +1,282 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   flat_json_reader_test.cpp
+ * Author: alex
+ *
+ * Created on December 7, 2020, 3:16 PM
+ */
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "staticlib/config/assert.hpp"
+#include "staticlib/io.hpp"
+#include "staticlib/json.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "flat_parsers.hpp"
+
+namespace { // anonymous
+
+namespace pdf = wilton::pdf;
+
+const std::string write_text_input = R"({"pdfDocumentHandle": 42, "fontName": "Helvetica",)"
+        R"( "fontSize": 12.5, "x": 10, "y": 20, "text": "Hello",)"
+        R"( "color": {"r": 0.1, "g": 0.5, "b": 1}})";
+
+const std::string write_text_inside_rectangle_input = R"({"pdfDocumentHandle": 42,)"
+        R"( "fontName": "Helvetica", "fontSize": 12, "text": "Hello", "left": 10, "top": 20,)"
+        R"( "right": 200, "bottom": 100, "align": "CENTER"})";
+
+const std::string draw_line_input = R"({"pdfDocumentHandle": 42, "beginX": 1, "beginY": 2,)"
+        R"( "endX": 300, "endY": 400, "lineWidth": 0.75, "color": {"b": 0, "g": 0.25, "r": 1}})";
+
+const std::string draw_rectangle_input = R"({"pdfDocumentHandle": 42, "x": 5, "y": 6,)"
+        R"( "width": 100, "height": 50})";
+
+// characters that change the meaning of JSON input when put at any position
+const std::string mutation_chars = std::string("\"\\{}[],:.-+eE09 \tax") +
+        std::string("\0\x01\x7f\xc3\xff", 5);
+
+bool equal(const pdf::rgb_color& a, const pdf::rgb_color& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+bool equal(const pdf::write_text_args& a, const pdf::write_text_args& b) {
+    return a.handle == b.handle &&
+            a.font_name == b.font_name &&
+            a.font_size == b.font_size &&
+            a.text == b.text &&
+            a.x == b.x &&
+            a.y == b.y &&
+            equal(a.color, b.color);
+}
+
+bool equal(const pdf::write_text_inside_rectangle_args& a, const pdf::write_text_inside_rectangle_args& b) {
+    return a.handle == b.handle &&
+            a.font_name == b.font_name &&
+            a.font_size == b.font_size &&
+            a.text == b.text &&
+            a.left == b.left &&
+            a.top == b.top &&
+            a.right == b.right &&
+            a.bottom == b.bottom &&
+            a.align == b.align &&
+            equal(a.color, b.color);
+}
+
+bool equal(const pdf::draw_line_args& a, const pdf::draw_line_args& b) {
+    return a.handle == b.handle &&
+            a.beginX == b.beginX &&
+            a.beginY == b.beginY &&
+            a.endX == b.endX &&
+            a.endY == b.endY &&
+            a.lineWidth == b.lineWidth &&
+            equal(a.color, b.color);
+}
+
+bool equal(const pdf::draw_rectangle_args& a, const pdf::draw_rectangle_args& b) {
+    return a.handle == b.handle &&
+            a.x == b.x &&
+            a.y == b.y &&
+            a.width == b.width &&
+            a.height == b.height &&
+            a.lineWidth == b.lineWidth &&
+            equal(a.color, b.color);
+}
+
+// flat reader may reject any input, but everything it accepts
+// must be accepted by the full parser with the same result
+template<typename Args>
+bool check_input(const std::string& input,
+        bool(*parse_flat)(sl::io::span<const char>, Args&),
+        Args(*parse)(const sl::json::value&, bool)) {
+    auto flat = Args();
+    if (!parse_flat(sl::io::span<const char>(input.data(), input.length()), flat)) {
+        return false;
+    }
+    auto json = sl::json::value();
+    auto full = Args();
+    try {
+        json = sl::json::load(input);
+        // flat parsers leave missing handle to the caller
+        full = parse(json, false);
+    } catch (const std::exception& e) {
+        throw wilton::support::exception(TRACEMSG("Input accepted by flat reader only," +
+                " input: [" + input + "], error: [" + e.what() + "]"));
+    }
+    if (!equal(flat, full)) {
+        throw wilton::support::exception(TRACEMSG("Flat reader result mismatch, input: [" + input + "]"));
+    }
+    return true;
+}
+
+template<typename Args>
+void check_mutations(const std::string& input,
+        bool(*parse_flat)(sl::io::span<const char>, Args&),
+        Args(*parse)(const sl::json::value&, bool)) {
+    // canonical input must not fall back to the full parser
+    slassert(check_input(input, parse_flat, parse));
+    for (size_t i = 0; i < input.length(); i++) {
+        check_input(input.substr(0, i), parse_flat, parse);
+        for (char ch : mutation_chars) {
+            auto replaced = input;
+            replaced[i] = ch;
+            check_input(replaced, parse_flat, parse);
+            auto inserted = input;
+            inserted.insert(i, 1, ch);
+            check_input(inserted, parse_flat, parse);
+        }
+    }
+}
+
+std::string replace_value(const std::string& input, const std::string& from, const std::string& to) {
+    auto idx = input.find(from);
+    slassert(std::string::npos != idx);
+    auto res = input;
+    res.replace(idx, from.length(), to);
+    return res;
+}
+
+void test_canonical() {
+    check_mutations(write_text_input, pdf::parse_write_text_flat, pdf::parse_write_text);
+    check_mutations(write_text_inside_rectangle_input, pdf::parse_write_text_inside_rectangle_flat,
+            pdf::parse_write_text_inside_rectangle);
+    check_mutations(draw_line_input, pdf::parse_draw_line_flat, pdf::parse_draw_line);
+    check_mutations(draw_rectangle_input, pdf::parse_draw_rectangle_flat, pdf::parse_draw_rectangle);
+}
+
+void test_escapes() {
+    auto accepted = std::vector<std::string>{
+        R"("a\"b")", R"("a\\b")", R"("a\/b")", R"("\b\f\n\r\t")", R"("\\\\")", R"("tail\n")",
+        "\"\xd0\x9f\xd1\x80\xd0\xb8\"", "\"\xe2\x82\xac\"", "\"\xf0\x9f\x98\x80\""
+    };
+    for (auto& st : accepted) {
+        auto input = replace_value(write_text_input, R"("Hello")", st);
+        slassert(check_input(input, pdf::parse_write_text_flat, pdf::parse_write_text));
+    }
+    auto rest = std::vector<std::string>{
+        R"("\u0041")", R"("\ud83d\ude00")", R"("\u0000")", R"("\x")", R"("\")",
+        R"("")", "\"\xc0\xaf\"", "\"\xed\xa0\x80\"", "\"\xf4\x90\x80\x80\"", "\"\xe2\x82\"", "\"a\tb\""
+    };
+    for (auto& st : rest) {
+        auto input = replace_value(write_text_input, R"("Hello")", st);
+        check_input(input, pdf::parse_write_text_flat, pdf::parse_write_text);
+    }
+    check_input(replace_value(write_text_input, R"("text")", R"("te\u0078t")"),
+            pdf::parse_write_text_flat, pdf::parse_write_text);
+}
+
+template<typename Args>
+void check_rejected(const std::string& input,
+        bool(*parse_flat)(sl::io::span<const char>, Args&),
+        Args(*parse)(const sl::json::value&, bool)) {
+    slassert(!check_input(input, parse_flat, parse));
+}
+
+void test_duplicates() {
+    // repeated fields are left to the full parser
+    check_rejected(replace_value(write_text_input, R"("x": 10)", R"("x": 10, "x": 11)"),
+            pdf::parse_write_text_flat, pdf::parse_write_text);
+    check_rejected(replace_value(write_text_input, R"("x": 10)", R"("x": 10, "x": 10)"),
+            pdf::parse_write_text_flat, pdf::parse_write_text);
+    check_rejected(replace_value(write_text_input, R"("text": "Hello")", R"("text": "Hello", "text": "Bye")"),
+            pdf::parse_write_text_flat, pdf::parse_write_text);
+    check_rejected(replace_value(write_text_input, R"("r": 0.1)", R"("r": 0.1, "r": 0.2)"),
+            pdf::parse_write_text_flat, pdf::parse_write_text);
+    check_rejected(replace_value(write_text_input, R"("color")", R"("color": {"r": 0, "g": 0, "b": 0}, "color")"),
+            pdf::parse_write_text_flat, pdf::parse_write_text);
+    check_rejected(replace_value(write_text_inside_rectangle_input, R"("align": "CENTER")",
+            R"("align": "LEFT", "align": "CENTER")"),
+            pdf::parse_write_text_inside_rectangle_flat, pdf::parse_write_text_inside_rectangle);
+    check_rejected(replace_value(draw_line_input, R"("lineWidth": 0.75)", R"("lineWidth": 0.75, "lineWidth": 2)"),
+            pdf::parse_draw_line_flat, pdf::parse_draw_line);
+    check_rejected(replace_value(draw_rectangle_input, R"("x": 5)", R"("pdfDocumentHandle": 43, "x": 5)"),
+            pdf::parse_draw_rectangle_flat, pdf::parse_draw_rectangle);
+}
+
+void test_numbers() {
+    auto ints = std::vector<std::string>{
+        "0", "-0", "1", "65535", "65536", "-1", "01", "1.0", "1e0", "1E2", "2147483648",
+        "9223372036854775807", "9223372036854775808", "-9223372036854775809",
+        "100000000000000000000000000000000", "0x10", "+1", "1.", ".1", "-", "1e", "1e+"
+    };
+    for (auto& num : ints) {
+        check_input(replace_value(write_text_input, R"("x": 10)", "\"x\": " + num),
+                pdf::parse_write_text_flat, pdf::parse_write_text);
+        check_input(replace_value(write_text_input, R"("pdfDocumentHandle": 42)",
+                "\"pdfDocumentHandle\": " + num),
+                pdf::parse_write_text_flat, pdf::parse_write_text);
+        check_input(replace_value(draw_rectangle_input, R"("width": 100)", "\"width\": " + num),
+                pdf::parse_draw_rectangle_flat, pdf::parse_draw_rectangle);
+    }
+    auto floats = std::vector<std::string>{
+        "0", "-0", "0.0", "-0.0", "12", "12.5", "1e1", "1E1", "1e+1", "1E-1", "1.5e-1", "0e0",
+        "0.5E+0", "12e0", "3.4028234e38", "3.5e38", "-3.5e38", "1e39", "1e400", "1e-400",
+        "1e-45", "0.1000000000000000055511151231257827", "123456789012345678901234567890",
+        "1.e1", "1e1.5", "e1", "--1", "1ee1", "NaN", "Infinity"
+    };
+    for (auto& num : floats) {
+        check_input(replace_value(write_text_input, R"("fontSize": 12.5)", "\"fontSize\": " + num),
+                pdf::parse_write_text_flat, pdf::parse_write_text);
+        check_input(replace_value(draw_line_input, R"("lineWidth": 0.75)", "\"lineWidth\": " + num),
+                pdf::parse_draw_line_flat, pdf::parse_draw_line);
+        check_input(replace_value(write_text_input, R"("g": 0.5)", "\"g\": " + num),
+                pdf::parse_write_text_flat, pdf::parse_write_text);
+    }
+}
+
+void test_structure() {
+    auto inputs = std::vector<std::string>{
+        "", " ", "{}", "[]", "null", write_text_input + " ", " \r\n\t" + write_text_input,
+        write_text_input + "}", write_text_input + ",", write_text_input + " {}",
+        replace_value(write_text_input, R"("x": 10)", R"("x": 10, "extra": 1)"),
+        replace_value(write_text_input, R"("x": 10)", R"("x": "10")"),
+        replace_value(write_text_input, R"("x": 10)", R"("x": null)"),
+        replace_value(write_text_input, R"("x": 10,)", ""),
+        replace_value(write_text_input, R"("b": 1)", R"("b": 1, "a": 1)"),
+        replace_value(write_text_input, R"(, "b": 1)", ""),
+        replace_value(write_text_input, R"("r": 0.1)", R"("r": 1.5)"),
+        replace_value(write_text_input, R"("r": 0.1)", R"("r": -0.1)"),
+        replace_value(write_text_input, R"({"r")", R"({ "r")"),
+        replace_value(write_text_input, R"(, "color": {"r": 0.1, "g": 0.5, "b": 1})", ""),
+        replace_value(write_text_input, R"({"r": 0.1, "g": 0.5, "b": 1})", "[0.1, 0.5, 1]")
+    };
+    for (auto& input : inputs) {
+        check_input(input, pdf::parse_write_text_flat, pdf::parse_write_text);
+    }
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_canonical();
+        test_escapes();
+        test_duplicates();
+        test_numbers();
+        test_structure();
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
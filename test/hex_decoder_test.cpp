@@ -0,0 +1,170 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   hex_decoder_test.cpp
+ * Author: alex
+ *
+ * Created on December 7, 2020, 5:40 PM
+ */
+
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "staticlib/config/assert.hpp"
+#include "staticlib/io.hpp"
+#include "staticlib/support.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "hex_decoder.hpp"
+
+namespace { // anonymous
+
+namespace pdf = wilton::pdf;
+
+// lengths up to 64 bytes cover two full SSE2 iterations and every tail length
+const size_t max_bytes = 64;
+
+const std::string invalid_chars = std::string("gG/:@`~ xz") + std::string("\0\x7f\x80\xff", 4);
+
+// reference decoder, does not share code with the tested one
+std::vector<char> decode_reference(const std::string& hex) {
+    static const std::string digits = "0123456789abcdef0123456789ABCDEF";
+    auto res = std::vector<char>();
+    for (size_t i = 0; i < hex.length(); i += 2) {
+        auto high = digits.find(hex[i]) % 16;
+        auto low = digits.find(hex[i + 1]) % 16;
+        res.push_back(static_cast<char>((high << 4) | low));
+    }
+    return res;
+}
+
+std::string random_hex(std::mt19937& rng, size_t bytes_count) {
+    static const std::string digits = "0123456789abcdefABCDEF";
+    auto dist = std::uniform_int_distribution<size_t>(0, digits.length() - 1);
+    auto res = std::string();
+    for (size_t i = 0; i < bytes_count * 2; i++) {
+        res.push_back(digits[dist(rng)]);
+    }
+    return res;
+}
+
+std::vector<char> decode(const std::string& hex) {
+    return pdf::decode_hex(sl::io::span<const char>(hex.data(), hex.length()));
+}
+
+// decoding must fail reporting the specified position
+void check_invalid(const std::string& hex, size_t pos) {
+    bool thrown = false;
+    try {
+        decode(hex);
+    } catch (const wilton::support::exception& e) {
+        thrown = true;
+        auto expected = "position: [" + sl::support::to_string(pos) + "]";
+        slassert(std::string::npos != std::string(e.what()).find(expected));
+    }
+    slassert(thrown);
+}
+
+void test_lengths() {
+    auto rng = std::mt19937(42);
+    for (size_t len = 0; len <= max_bytes; len++) {
+        for (size_t round = 0; round < 16; round++) {
+            auto hex = random_hex(rng, len);
+            slassert(decode_reference(hex) == decode(hex));
+        }
+    }
+}
+
+void test_case() {
+    // every byte value in lower, upper and mixed case
+    auto lower = std::string();
+    for (int i = 0; i < 256; i++) {
+        lower += "0123456789abcdef"[i >> 4];
+        lower += "0123456789abcdef"[i & 0xf];
+    }
+    auto upper = std::string();
+    auto mixed = std::string();
+    for (size_t i = 0; i < lower.length(); i++) {
+        char up = static_cast<char>(std::toupper(static_cast<unsigned char>(lower[i])));
+        upper.push_back(up);
+        mixed.push_back(0 == i % 3 ? up : lower[i]);
+    }
+    auto expected = std::vector<char>();
+    for (int i = 0; i < 256; i++) {
+        expected.push_back(static_cast<char>(i));
+    }
+    slassert(expected == decode(lower));
+    slassert(expected == decode(upper));
+    slassert(expected == decode(mixed));
+    for (size_t from = 0; from < 64; from += 2) {
+        auto part = mixed.substr(from, 66);
+        slassert(decode_reference(part) == decode(part));
+    }
+}
+
+void test_invalid_chars() {
+    auto rng = std::mt19937(43);
+    for (size_t len = 1; len <= max_bytes; len++) {
+        auto hex = random_hex(rng, len);
+        for (size_t pos = 0; pos < hex.length(); pos++) {
+            for (char ch : invalid_chars) {
+                auto broken = hex;
+                broken[pos] = ch;
+                check_invalid(broken, pos);
+            }
+        }
+    }
+    // first invalid digit is reported
+    auto hex = random_hex(rng, max_bytes);
+    hex[40] = 'x';
+    hex[7] = 'x';
+    check_invalid(hex, 7);
+}
+
+void test_odd_length() {
+    auto rng = std::mt19937(44);
+    for (size_t len = 0; len <= max_bytes; len++) {
+        auto hex = random_hex(rng, len) + "a";
+        bool thrown = false;
+        try {
+            decode(hex);
+        } catch (const wilton::support::exception&) {
+            thrown = true;
+        }
+        slassert(thrown);
+    }
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_lengths();
+        test_case();
+        test_invalid_chars();
+        test_odd_length();
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   page_state_test.cpp
+ * Author: alex
+ *
+ * Created on December 16, 2020, 11:20 AM
+ */
+
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "hpdf.h"
+
+#include "staticlib/config/assert.hpp"
+
+#include "page_state.hpp"
+
+namespace { // anonymous
+
+namespace pdf = wilton::pdf;
+
+class test_document {
+public:
+    HPDF_Doc doc;
+
+    test_document() :
+    doc(HPDF_New([](HPDF_STATUS error_no, HPDF_STATUS, void*) {
+        throw std::runtime_error("haru error: [" + std::to_string(error_no) + "]");
+    }, nullptr)) {
+        if (nullptr == doc) throw std::runtime_error("'HPDF_New' error");
+    }
+
+    test_document(const test_document&) = delete;
+
+    test_document& operator=(const test_document&) = delete;
+
+    ~test_document() {
+        HPDF_Free(doc);
+    }
+};
+
+// 'draw_line' op
+void draw_line(HPDF_Page page) {
+    HPDF_Page_SetLineWidth(page, 1);
+    HPDF_Page_MoveTo(page, 10, 10);
+    HPDF_Page_LineTo(page, 100, 100);
+    HPDF_Page_Stroke(page);
+}
+
+// op, that fails after the page was switched to text object
+bool failed_in_text_object(HPDF_Doc doc, HPDF_Page page) {
+    try {
+        HPDF_Page_SetFontAndSize(page, HPDF_GetFont(doc, "Helvetica", nullptr), 12);
+        HPDF_Page_BeginText(page);
+        // text operators are not allowed in text object
+        HPDF_Page_BeginText(page);
+    } catch (const std::exception&) {
+        return true;
+    }
+    return false;
+}
+
+void test_failed_op_followed_by_successful_one() {
+    test_document td;
+    HPDF_Page page = HPDF_AddPage(td.doc);
+    slassert(failed_in_text_object(td.doc, page));
+    slassert(HPDF_GMODE_TEXT_OBJECT == HPDF_Page_GetGMode(page));
+    slassert(pdf::restore_page_state(td.doc));
+    slassert(HPDF_GMODE_PAGE_DESCRIPTION == HPDF_Page_GetGMode(page));
+    slassert(HPDF_OK == HPDF_GetError(td.doc));
+    draw_line(page);
+    slassert(HPDF_OK == HPDF_SaveToStream(td.doc));
+}
+
+void test_path_object() {
+    test_document td;
+    HPDF_Page page = HPDF_AddPage(td.doc);
+    HPDF_Page_MoveTo(page, 10, 10);
+    slassert(HPDF_GMODE_PATH_OBJECT == HPDF_Page_GetGMode(page));
+    slassert(pdf::restore_page_state(td.doc));
+    slassert(HPDF_GMODE_PAGE_DESCRIPTION == HPDF_Page_GetGMode(page));
+    draw_line(page);
+}
+
+void test_no_page() {
+    test_document td;
+    slassert(pdf::restore_page_state(td.doc));
+    HPDF_Page page = HPDF_AddPage(td.doc);
+    draw_line(page);
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_failed_op_followed_by_successful_one();
+        test_path_object();
+        test_no_page();
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2020, alex at staticlibs.net
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File:   pdf_template_test.cpp
+ * Author: alex
+ *
+ * Created on December 14, 2020, 11:05 AM
+ */
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "staticlib/config/assert.hpp"
+#include "staticlib/json.hpp"
+
+#include "wilton/support/exception.hpp"
+
+#include "pdf_template.hpp"
+
+namespace { // anonymous
+
+namespace pdf = wilton::pdf;
+
+const std::string content_ops = R"([)"
+        R"({"op": "load_font", "args": {"ttfPath": "font.ttf"}},)"
+        R"({"op": "add_page", "args": {"format": "A4", "orientation": "PORTRAIT"}},)"
+        R"({"op": "load_image", "args": {"imagePath": "logo.png", "imageFormat": "PNG"}},)"
+        R"({"op": "write_text", "args": {"fontName": "F1", "fontSize": 12, "x": 1, "y": 2, "text": "a"}},)"
+        R"({"op": "write_text_inside_rectangle"},)"
+        R"({"op": "draw_line"},)"
+        R"({"op": "draw_rectangle"},)"
+        R"({"op": "draw_image", "args": {"imageId": 0, "x": 1, "y": 2, "width": 3, "height": 4}})"
+        R"(])";
+
+// ops must be refused before any document is built
+bool refused(const std::string& ops) {
+    try {
+        pdf::check_template_ops(sl::json::load(ops));
+    } catch (const wilton::support::exception&) {
+        return true;
+    }
+    return false;
+}
+
+void test_content_ops() {
+    slassert(!refused(content_ops));
+    slassert(!refused("[]"));
+}
+
+void test_save_ops() {
+    slassert(refused(R"([{"op": "add_page", "args": {"format": "A4", "orientation": "PORTRAIT"}},)"
+            R"({"op": "save_to_file", "args": {"path": "out.pdf"}}])"));
+    slassert(refused(R"([{"op": "save_to_stream", "args": {"fd": 1}}])"));
+    slassert(refused(R"([{"op": "save_to_buffer"}])"));
+}
+
+void test_unknown_ops() {
+    slassert(refused(R"([{"op": "destroy_document"}])"));
+    slassert(refused(R"([{"op": ""}])"));
+    // malformed entries are reported when ops are applied
+    slassert(!refused(R"([{"args": {}}, {"op": 42}])"));
+}
+
+// documents are not used by the template, so stub documents are built
+// without haru, null document is ignored by HPDF_Free
+class stub_factory {
+public:
+    std::shared_ptr<std::atomic<int>> calls = std::make_shared<std::atomic<int>>(0);
+
+    std::function<std::unique_ptr<pdf::pdf_context>()> fun() {
+        auto counter = calls;
+        return [counter] {
+            counter->fetch_add(1);
+            return stub_document();
+        };
+    }
+
+    static std::unique_ptr<pdf::pdf_context> stub_document() {
+        return std::unique_ptr<pdf::pdf_context>(new pdf::pdf_context(nullptr,
+                std::make_shared<pdf::memory_account>()));
+    }
+};
+
+sl::json::value stub_results() {
+    return sl::json::load(R"([{"fontName": "F1"}, null])");
+}
+
+bool wait_for(std::function<bool()> pred) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+int64_t available(pdf::pdf_template& tpl) {
+    return tpl.stats()["available"].as_int64();
+}
+
+void test_fork_spare() {
+    auto refiller = std::make_shared<pdf::pool_refiller>();
+    stub_factory sf;
+    auto first = stub_factory::stub_document();
+    auto first_ptr = first.get();
+    pdf::pdf_template tpl(sf.fun(), stub_results(), std::move(first), 0, refiller);
+    // first document is handed off without building a new one
+    auto doc1 = tpl.fork();
+    slassert(first_ptr == doc1.get());
+    slassert(0 == sf.calls->load());
+    // unpooled template builds documents on the caller thread
+    auto doc2 = tpl.fork();
+    slassert(nullptr != doc2.get());
+    slassert(doc1.get() != doc2.get());
+    slassert(1 == sf.calls->load());
+    slassert(0 == tpl.stats()["size"].as_int64());
+    slassert(stub_results().dumps() == tpl.prefix_results().dumps());
+    refiller->stop();
+}
+
+void test_pool_refill() {
+    auto refiller = std::make_shared<pdf::pool_refiller>();
+    stub_factory sf;
+    auto first = stub_factory::stub_document();
+    auto first_ptr = first.get();
+    pdf::pdf_template tpl(sf.fun(), stub_results(), std::move(first), 2, refiller);
+    // first document is pooled, one more is built by refiller
+    slassert(wait_for([&tpl] { return 2 == available(tpl); }));
+    slassert(1 == sf.calls->load());
+    auto doc1 = tpl.fork();
+    slassert(first_ptr == doc1.get());
+    slassert(1 == tpl.stats()["hits"].as_int64());
+    // taken document is replaced
+    slassert(wait_for([&tpl] { return 2 == available(tpl); }));
+    slassert(2 == sf.calls->load());
+    auto doc2 = tpl.fork();
+    auto doc3 = tpl.fork();
+    slassert(nullptr != doc2.get());
+    slassert(nullptr != doc3.get());
+    slassert(3 == tpl.stats()["hits"].as_int64());
+    slassert(wait_for([&tpl] { return 2 == available(tpl); }));
+    slassert(4 == sf.calls->load());
+    refiller->stop();
+}
+
+void test_pool_factory_error() {
+    auto refiller = std::make_shared<pdf::pool_refiller>();
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    auto fac = [calls]() -> std::unique_ptr<pdf::pdf_context> {
+        calls->fetch_add(1);
+        throw wilton::support::exception(TRACEMSG("factory error"));
+    };
+    pdf::pdf_template tpl(fac, stub_results(), stub_factory::stub_document(), 2, refiller);
+    // refilling is stopped after the first error
+    slassert(wait_for([&tpl] { return !tpl.stats()["lastError"].as_string().empty(); }));
+    slassert(1 == calls->load());
+    slassert(nullptr != tpl.fork().get());
+    // pool is exhausted, document is built on the caller thread
+    bool thrown = false;
+    try {
+        tpl.fork();
+    } catch (const wilton::support::exception&) {
+        thrown = true;
+    }
+    slassert(thrown);
+    refiller->stop();
+}
+
+void test_destroy_with_live_forks() {
+    auto refiller = std::make_shared<pdf::pool_refiller>();
+    stub_factory sf;
+    auto tpl = std::make_shared<pdf::pdf_template>(sf.fun(), stub_results(),
+            stub_factory::stub_document(), 2, refiller);
+    slassert(wait_for([&tpl] { return 2 == available(*tpl); }));
+    auto doc1 = tpl->fork();
+    auto doc2 = tpl->fork();
+    tpl.reset();
+    // forks are owned by their callers
+    slassert(nullptr != doc1->memory.get());
+    slassert(nullptr != doc2->memory.get());
+    // refiller forgets destroyed pool and serves the others
+    stub_factory sf_other;
+    pdf::pdf_template other(sf_other.fun(), stub_results(), stub_factory::stub_document(), 3, refiller);
+    slassert(wait_for([&other] { return 3 == available(other); }));
+    slassert(2 == sf_other.calls->load());
+    refiller->stop();
+    // pre-built documents remain available after stop
+    slassert(nullptr != other.fork().get());
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_content_ops();
+        test_save_ops();
+        test_unknown_ops();
+        test_fork_spare();
+        test_pool_refill();
+        test_pool_factory_error();
+        test_destroy_with_live_forks();
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}